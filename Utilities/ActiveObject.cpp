@@ -7,6 +7,23 @@
 #include <atomic>
 #include <thread>
 #include <future>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <tuple>
+#include <new>
+#include <cstddef>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <array>
+#include <optional>
+#include <cstdint>
+#include <numeric>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 using namespace std;
 
@@ -15,8 +32,30 @@ class Job
     
 public:
 
-    ~Job() noexcept = default;
+    // the link to the next message in the mailbox
+    atomic<Job*> mNext{};
+    
+    // the quit message: the actor stops when it gets to it
+    bool mQuit{};
+    
+    // a coalescing message, and the key of the state it overwrites
+    bool mCoalesce{};
+    size_t mKey{};
+    
+    // the earlier messages with the same key that this one replaced (linked through their own mAbsorbed)
+    Job* mAbsorbed{};
+    bool mSuperseded{};
+    
+    // a replaced message that never ran goes along with the one that replaced it
+    virtual ~Job() noexcept
+    {
+        delete mAbsorbed;
+    }
+    
     virtual void execute() = 0;
+    
+    // this message was replaced by a later one with the same key, which has now run
+    virtual void absorb() {}
 };
 
 template <
@@ -35,106 +74,1418 @@ public:
     }
 };
 
-class ActiveObject
+template <
+    typename F>
+class CoalescedJob : public Job
 {
-    double val{};
-    mutex mMutex{};
-    condition_variable mCV{};
-    deque<shared_ptr<Job>> q{};
+    F mFn;
+    promise<void> mDone{};
     
-    unique_ptr<thread> mRunnable{};
-    atomic<bool> mDone{};
+public:
+
+    CoalescedJob(size_t key, F fn) : mFn(move(fn))
+    {
+        mCoalesce = true;
+        mKey = key;
+    }
+    
+    future<void> get_future()
+    {
+        return mDone.get_future();
+    }
+    
+    virtual void execute()
+    {
+        try
+        {
+            mFn();
+            mDone.set_value();
+        }
+        catch (...)
+        {
+            mDone.set_exception(current_exception());
+        }
+    }
+    
+    virtual void absorb()
+    {
+        mDone.set_value();
+    }
+};
+
+// a message with no result: the callable is stored inside the message (or, if it is too big, behind a pointer there),
+// and the message itself is a fixed-size node recycled by MessagePool, so that posting one allocates nothing once the
+// pool is warm
+// nothing carries an exception out of it, so one that escapes ends the program, as it would on a thread of its own
+class PostedJob final : public Job
+{
     
 public:
 
-    ActiveObject()
+    static constexpr size_t InlineSize = 64;
+    
+private:
+
+    alignas(max_align_t) unsigned char mStorage[InlineSize];
+    void (*mInvoke)(void*){};
+    void (*mDestroy)(void*){};
+    
+public:
+
+    template <
+        typename F>
+    explicit PostedJob(F&& f)
     {
-        mRunnable = make_unique<thread>(
-            [this]()
-            {
-                while (!mDone)
-                { 
-                    shared_ptr<Job> pJob{};
-                    {
-                        unique_lock<mutex> lk(mMutex);
-                        mCV.wait(lk, [this](){return !q.empty();});
-                        pJob = move(q.back()); q.pop_back();
-                    }
-                    
-                    if (!pJob)
-                    {
-                        return;
-                    }
-                    
-                    pJob->execute();
-                }
-            }
-        );
+        using Fn = decay_t<F>;
+        
+        if constexpr (sizeof(Fn) <= InlineSize && alignof(Fn) <= alignof(max_align_t))
+        {
+            new (mStorage) Fn(forward<F>(f));
+            mInvoke = [](void* p){(*static_cast<Fn*>(p))();};
+            mDestroy = [](void* p){static_cast<Fn*>(p)->~Fn();};
+        }
+        else
+        {
+            new (mStorage) Fn*(new Fn(forward<F>(f)));
+            mInvoke = [](void* p){(**static_cast<Fn**>(p))();};
+            mDestroy = [](void* p){delete *static_cast<Fn**>(p);};
+        }
     }
     
-    ~ActiveObject() 
+    PostedJob(const PostedJob&) = delete;
+    PostedJob& operator=(const PostedJob&) = delete;
+    
+    ~PostedJob() noexcept
     {
-        sendQuitMessage();
-        mRunnable->join();
+        mDestroy(mStorage);
     }
     
-    void sendQuitMessage()
+    virtual void execute()
+    {
+        mInvoke(mStorage);
+    }
+    
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+};
+
+// the nodes of PostedJob
+// each thread keeps a free list of its own, and trades nodes with a shared depot a chunk at a time, so that the depot's
+// lock is taken once per Chunk messages, and the nodes freed on the actor's side find their way back to the posters
+// the nodes are never given back to the system; the pool is as big as the most messages ever in flight at once
+class MessagePool
+{
+    struct FreeNode
+    {
+        FreeNode* mNext;
+    };
+    
+    static constexpr size_t NodeSize = sizeof(PostedJob);
+    static constexpr size_t Chunk = 64;
+    
+    struct Depot
     {
+        mutex mMutex{};
+        vector<pair<FreeNode*, size_t>> mChunks{};
+    };
+    
+    struct Cache
+    {
+        FreeNode* mHead{};
+        size_t mCount{};
+        
+        // a thread that goes away leaves its nodes to the others
+        ~Cache()
         {
-            unique_lock<mutex> lk(mMutex);
-            q.push_front(nullptr);
+            if (mHead)
+            {
+                lock_guard<mutex> lk(depot().mMutex);
+                depot().mChunks.emplace_back(mHead, mCount);
+            }
         }
+    };
+    
+    // never destroyed, since threads hand back their nodes as they exit, which may be after static destruction began
+    static Depot& depot()
+    {
+        static Depot* pDepot = new Depot{};
+        return *pDepot;
     }
+    
+    static Cache& cache()
+    {
+        thread_local Cache tlsCache{};
+        return tlsCache;
+    }
+    
+    static void refill(Cache& c)
+    {
+        {
+            Depot& d = depot();
+            lock_guard<mutex> lk(d.mMutex);
+            
+            if (!d.mChunks.empty())
+            {
+                tie(c.mHead, c.mCount) = d.mChunks.back();
+                d.mChunks.pop_back();
+                return;
+            }
+        }
         
-    auto func1()
+        auto slab = static_cast<unsigned char*>(::operator new(NodeSize * Chunk));
+        
+        for (size_t i = Chunk; i-- > 0; )
+        {
+            auto node = reinterpret_cast<FreeNode*>(slab + i * NodeSize);
+            node->mNext = c.mHead;
+            c.mHead = node;
+        }
+        
+        c.mCount = Chunk;
+    }
+    
+    // keep Chunk nodes, hand the other Chunk to the depot
+    static void spill(Cache& c)
     {
-        auto l = [this]()
+        FreeNode* head = c.mHead;
+        FreeNode* last = head;
+        
+        for (size_t i = 1; i < Chunk; ++i)
         {
-            val = 1.1;
-            cout << "func1" << '\n';
-        };
+            last = last->mNext;
+        }
         
-        return enqueue_work(l);
+        c.mHead = last->mNext;
+        c.mCount -= Chunk;
+        last->mNext = nullptr;
+        
+        Depot& d = depot();
+        lock_guard<mutex> lk(d.mMutex);
+        d.mChunks.emplace_back(head, Chunk);
     }
     
-    auto func2()
+public:
+
+    static void* allocate()
     {
-        auto l = [this]()
+        Cache& c = cache();
+        
+        if (!c.mHead)
         {
-            val = 2.2;
-            cout << "func2" << '\n';
-        };
+            refill(c);
+        }
         
-        return enqueue_work(l);
+        FreeNode* node = c.mHead;
+        c.mHead = node->mNext;
+        --c.mCount;
+        
+        return node;
+    }
+    
+    static void deallocate(void* p)
+    {
+        Cache& c = cache();
+        
+        auto node = static_cast<FreeNode*>(p);
+        node->mNext = c.mHead;
+        c.mHead = node;
+        
+        if (++c.mCount == 2 * Chunk)
+        {
+            spill(c);
+        }
     }
+};
 
-private:
+inline void* PostedJob::operator new(size_t)
+{
+    return MessagePool::allocate();
+}
 
-    template<
-        typename F,
-        typename... Args>
-    future<result_of_t<F(Args...)>> enqueue_work(F&& f, Args&&... args)
+inline void PostedJob::operator delete(void* p)
+{
+    MessagePool::deallocate(p);
+}
+
+class QuitJob : public Job
+{
+    
+public:
+
+    QuitJob()
+    {
+        mQuit = true;
+    }
+    
+    virtual void execute() {}
+};
+
+// Vyukov's intrusive multi-producer single-consumer queue: a post is a single exchange of the head, whatever the
+// number of producers; the consumer alone moves the tail, so it needs no atomic read-modify-write at all
+// a producer links its message to its predecessor only after the exchange, so for a moment the consumer may find the
+// queue neither empty nor poppable; pop() then returns nothing while empty() says false, and the consumer retries
+class Mailbox
+{
+    class Stub : public Job
     {
-        using RetType = result_of_t<F(Args...)>;
         
-        packaged_task<RetType()> p(bind(forward<F>(f), forward<Args>(args)...));
-        future<RetType> fut = p.get_future();
+    public:
+    
+        virtual void execute() {}
+    };
+    
+    atomic<Job*> mHead;
+    Job* mTail;
+    Stub mStub{};
+    
+public:
+
+    Mailbox() : mHead(&mStub), mTail(&mStub) {}
+    
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+    
+    // the messages nobody got to
+    ~Mailbox()
+    {
+        while (!empty())
+        {
+            if (Job* pJob = pop())
+            {
+                delete pJob;
+            }
+        }
+    }
+    
+    // any thread
+    void push(Job* pJob)
+    {
+        pJob->mNext.store(nullptr, memory_order_relaxed);
+        Job* prev = mHead.exchange(pJob, memory_order_seq_cst);
+        prev->mNext.store(pJob, memory_order_release);
+    }
+    
+    // the consumer only
+    Job* pop()
+    {
+        Job* tail = mTail;
+        Job* next = tail->mNext.load(memory_order_acquire);
+        
+        if (tail == &mStub)
+        {
+            if (!next)
+            {
+                return nullptr;
+            }
+            
+            mTail = next;
+            tail = next;
+            next = next->mNext.load(memory_order_acquire);
+        }
+        
+        if (next)
+        {
+            mTail = next;
+            return tail;
+        }
+        
+        if (tail != mHead.load(memory_order_acquire))
+        {
+            // a producer is between its exchange and its link
+            return nullptr;
+        }
+        
+        // tail is the last message; put the stub behind it, so that it can be taken without emptying the list
+        push(&mStub);
+        
+        next = tail->mNext.load(memory_order_acquire);
+        if (next)
+        {
+            mTail = next;
+            return tail;
+        }
         
+        return nullptr;
+    }
+    
+    // the consumer only
+    bool empty() const
+    {
+        return mTail == &mStub && mHead.load(memory_order_seq_cst) == &mStub;
+    }
+    
+    // any thread: whether something was posted since the consumer last found the mailbox empty
+    // (for a consumer that has just handed over its role, and so must not look at the tail any more)
+    bool posted() const
+    {
+        return mHead.load(memory_order_seq_cst) != &mStub;
+    }
+};
+
+// an eventcount: the consumer announces that it is about to sleep, checks its condition once more, and sleeps only
+// if nothing has been notified since the announcement
+// a producer that finds nobody announced (the common case for a busy actor) gets away with a single load
+class EventCount
+{
+    atomic<uint64_t> mEpoch{};
+    atomic<int> mWaiters{};
+    mutex mMutex{};
+    condition_variable mCV{};
+    
+public:
+
+    uint64_t prepare_wait()
+    {
+        mWaiters.fetch_add(1, memory_order_seq_cst);
+        return mEpoch.load(memory_order_seq_cst);
+    }
+    
+    void cancel_wait()
+    {
+        mWaiters.fetch_sub(1, memory_order_relaxed);
+    }
+    
+    void wait(uint64_t key)
+    {
         {
             unique_lock<mutex> lk(mMutex);
-            q.push_front(make_shared<AnyJob<RetType>>(move(p)));
-            mCV.notify_all();
+            mCV.wait(lk, [this, key](){return mEpoch.load(memory_order_relaxed) != key;});
         }
         
-        return fut;
+        mWaiters.fetch_sub(1, memory_order_relaxed);
+    }
+    
+    template <
+        typename Clock,
+        typename Duration>
+    void wait_until(uint64_t key, chrono::time_point<Clock, Duration> deadline)
+    {
+        {
+            unique_lock<mutex> lk(mMutex);
+            mCV.wait_until(lk, deadline, [this, key](){return mEpoch.load(memory_order_relaxed) != key;});
+        }
+        
+        mWaiters.fetch_sub(1, memory_order_relaxed);
+    }
+    
+    // after making the condition true
+    void notify()
+    {
+        if (mWaiters.load(memory_order_seq_cst) == 0)
+        {
+            return;
+        }
+        
+        {
+            lock_guard<mutex> lk(mMutex);
+            mEpoch.fetch_add(1, memory_order_relaxed);
+        }
+        
+        mCV.notify_all();
+    }
+    
+    // a blocking handshake, for when the notifier must be done with the eventcount before the waiter returns (say,
+    // because the waiter is about to destroy it): update runs and the waiters are woken under the lock
+    template <
+        typename Update>
+    void publish(Update update)
+    {
+        lock_guard<mutex> lk(mMutex);
+        update();
+        mEpoch.fetch_add(1, memory_order_relaxed);
+        mCV.notify_all();
+    }
+    
+    template <
+        typename Predicate>
+    void await(Predicate predicate)
+    {
+        unique_lock<mutex> lk(mMutex);
+        mCV.wait(lk, predicate);
     }
 };
 
-int main()
+class ActiveObject;
+
+// a shared set of threads on which any number of ActiveObjects run as strands
+// an actor is on the pool's queue only while its mailbox has messages, so an idle actor costs its mailbox and no thread
+// the pool must outlive the actors that run on it
+class ActorPool
 {
-    ActiveObject ao{};
-    ao.func1();
-    ao.func2();
+    using TimePoint = chrono::steady_clock::time_point;
+    using Wakeup = pair<TimePoint, ActiveObject*>;
+    
+    mutex mMutex{};
+    condition_variable mCV{};
+    deque<ActiveObject*> mReady{};
+    
+    // when strands with timers want to be run again, earliest first (a heap); a stale entry only costs a turn
+    vector<Wakeup> mWakeups{};
+    
+    vector<thread> mWorkers{};
+    bool mDone{};
+    
+    void run();
+    
+    // under mMutex: queue the strands whose wakeup is due
+    void wake_due();
+    
+public:
+
+    explicit ActorPool(int numThreads = thread::hardware_concurrency())
+    {
+        for (int i = 0; i < max(numThreads, 1); ++i)
+        {
+            mWorkers.emplace_back([this](){run();});
+        }
+    }
+    
+    ~ActorPool()
+    {
+        {
+            unique_lock<mutex> lk(mMutex);
+            mDone = true;
+        }
+        
+        mCV.notify_all();
+        
+        for (auto& worker : mWorkers)
+        {
+            worker.join();
+        }
+    }
+    
+    void schedule(ActiveObject* actor)
+    {
+        {
+            unique_lock<mutex> lk(mMutex);
+            mReady.push_back(actor);
+        }
+        
+        mCV.notify_one();
+    }
+    
+    // run actor once more at when (for its timers), whether or not it has messages by then
+    void wake_at(ActiveObject* actor, TimePoint when)
+    {
+        bool earliest{};
+        {
+            unique_lock<mutex> lk(mMutex);
+            mWakeups.emplace_back(when, actor);
+            push_heap(mWakeups.begin(), mWakeups.end(), greater<Wakeup>{});
+            earliest = mWakeups.front().second == actor && mWakeups.front().first == when;
+        }
+        
+        // a sleeping worker may be waiting for a later one
+        if (earliest)
+        {
+            mCV.notify_one();
+        }
+    }
+    
+    // drop the wakeups of an actor that is going away
+    void forget(ActiveObject* actor)
+    {
+        unique_lock<mutex> lk(mMutex);
+        mWakeups.erase(remove_if(mWakeups.begin(), mWakeups.end(), [actor](const Wakeup& w){return w.second == actor;}), mWakeups.end());
+        make_heap(mWakeups.begin(), mWakeups.end(), greater<Wakeup>{});
+    }
+};
+
+class ActiveObject
+{
+    friend class ActorPool;
+    
+    // the most messages taken out of the mailbox at a time; a strand runs one batch a turn before going to the back of
+    // the pool's queue, so that a busy actor can't starve the rest
+    static constexpr size_t Batch = 64;
+    
+    using Clock = chrono::steady_clock;
+    
+    // a timer: fn runs on the actor at deadline, and then every period, if it has one
+    struct Timer
+    {
+        Clock::time_point mDeadline;
+        Clock::duration mPeriod;
+        uint64_t mId;
+        function<void()> mFn;
+        
+        bool operator>(const Timer& other) const
+        {
+            return mDeadline > other.mDeadline;
+        }
+    };
+    
+    static constexpr Clock::rep NoTimer = numeric_limits<Clock::rep>::max();
+    
+    double val{};
+    Mailbox mMailbox{};
+    
+    // the priority lane: control messages, run ahead of whatever waits in the mailbox
+    Mailbox mUrgent{};
+    
+    EventCount mEvents{};
+    
+    // the timers (a heap, earliest first), and the id of the one running now (and whether it got cancelled meanwhile)
+    mutex mTimerMutex{};
+    vector<Timer> mTimers{};
+    uint64_t mNextTimerId{1};
+    uint64_t mFiring{};
+    bool mFiringCancelled{};
+    
+    // the earliest deadline, so that the runnable loop can skip the timers with a load; and, for a strand, the earliest
+    // wakeup asked of the pool that is still to come
+    atomic<Clock::rep> mNextDeadline{NoTimer};
+    atomic<Clock::rep> mWakeAt{NoTimer};
+    
+    // the pool came to wake this strand while it was running, and so couldn't (see run_slice)
+    atomic<bool> mMissedWakeup{};
+    
+    // either a dedicated thread drains the mailbox, or (as a strand) the threads of mPool do, one at a time
+    unique_ptr<thread> mRunnable{};
+    ActorPool* mPool{};
+    
+    // a strand is on, or running in, the pool; it stays set after the quit message, so that nobody schedules it again
+    atomic<bool> mScheduled{};
+    atomic<bool> mDone{};
+    
+    // the coalescing keys of func1 and func2
+    static constexpr size_t Func1Key = 1;
+    static constexpr size_t Func2Key = 2;
+    
+    void push(Job* pJob, Mailbox& box)
+    {
+        box.push(pJob);
+        
+        if (!mPool)
+        {
+            // the runnable may be asleep on an empty mailbox
+            mEvents.notify();
+            return;
+        }
+        
+        // a strand is handed to the pool by whoever finds it idle, and stays there until its mailboxes run dry
+        // (a seq_cst load after the exchange in push, against the store and re-check in run_slice)
+        if (!mScheduled.load(memory_order_seq_cst) && !mScheduled.exchange(true, memory_order_seq_cst))
+        {
+            mPool->schedule(this);
+        }
+    }
+    
+    void push(Job* pJob)
+    {
+        push(pJob, mMailbox);
+    }
+    
+    // the consumer only
+    bool idle() const
+    {
+        return mMailbox.empty() && mUrgent.empty();
+    }
+    
+    // run what is on the priority lane; false if it had the quit message
+    bool run_urgent()
+    {
+        while (Job* pJob = mUrgent.pop())
+        {
+            unique_ptr<Job> job{pJob};
+            
+            if (job->mQuit)
+            {
+                return false;
+            }
+            
+            job->execute();
+        }
+        
+        return true;
+    }
+    
+    // under mTimerMutex, after the timers changed
+    void timers_changed()
+    {
+        Clock::rep next = mTimers.empty() ? NoTimer : mTimers.front().mDeadline.time_since_epoch().count();
+        mNextDeadline.store(next, memory_order_seq_cst);
+        
+        // a dedicated thread sleeps until the next deadline by itself; a strand has the pool run it then
+        if (mPool && next < mWakeAt.load(memory_order_relaxed))
+        {
+            mWakeAt.store(next, memory_order_relaxed);
+            mPool->wake_at(this, mTimers.front().mDeadline);
+        }
+    }
+    
+    uint64_t arm(Clock::time_point deadline, Clock::duration period, function<void()> fn)
+    {
+        uint64_t id{};
+        {
+            lock_guard<mutex> lk(mTimerMutex);
+            
+            id = mNextTimerId++;
+            mTimers.push_back({deadline, period, id, move(fn)});
+            push_heap(mTimers.begin(), mTimers.end(), greater<Timer>{});
+            
+            timers_changed();
+        }
+        
+        // the runnable may be asleep until a later deadline (or none)
+        if (!mPool)
+        {
+            mEvents.notify();
+        }
+        
+        return id;
+    }
+    
+    // run the timers that are due, one at a time and without the lock, so that they may arm and cancel timers
+    void run_timers()
+    {
+        Clock::rep wakeAt = mWakeAt.load(memory_order_relaxed);
+        
+        if (mNextDeadline.load(memory_order_seq_cst) == NoTimer && wakeAt == NoTimer)
+        {
+            return;
+        }
+        
+        Clock::time_point now = Clock::now();
+        
+        // the pool has run this strand for its wakeup (or will, to no effect); the next deadline needs one of its own
+        if (wakeAt <= now.time_since_epoch().count())
+        {
+            lock_guard<mutex> lk(mTimerMutex);
+            mWakeAt.store(NoTimer, memory_order_relaxed);
+            timers_changed();
+        }
+        
+        while (true)
+        {
+            Timer timer{};
+            {
+                lock_guard<mutex> lk(mTimerMutex);
+                
+                if (mTimers.empty() || mTimers.front().mDeadline > now)
+                {
+                    return;
+                }
+                
+                pop_heap(mTimers.begin(), mTimers.end(), greater<Timer>{});
+                timer = move(mTimers.back());
+                mTimers.pop_back();
+                
+                mFiring = timer.mPeriod == Clock::duration::zero() ? 0 : timer.mId;
+                mFiringCancelled = false;
+                
+                timers_changed();
+            }
+            
+            timer.mFn();
+            
+            lock_guard<mutex> lk(mTimerMutex);
+            mFiring = 0;
+            
+            if (timer.mPeriod == Clock::duration::zero() || mFiringCancelled)
+            {
+                continue;
+            }
+            
+            // due one period after the previous run was, or right away if that has passed
+            timer.mDeadline = max(timer.mDeadline + timer.mPeriod, Clock::now());
+            mTimers.push_back(move(timer));
+            push_heap(mTimers.begin(), mTimers.end(), greater<Timer>{});
+            
+            timers_changed();
+        }
+    }
+    
+    // take what is in the mailbox, up to a batch, and collapse the coalescing messages in it
+    size_t take_batch(Job* (&batch)[Batch])
+    {
+        size_t n = 0;
+        size_t numCoalescing = 0;
+        
+        while (n < Batch)
+        {
+            Job* pJob = mMailbox.pop();
+            
+            if (!pJob)
+            {
+                break;
+            }
+            
+            numCoalescing += pJob->mCoalesce;
+            batch[n++] = pJob;
+        }
+        
+        if (numCoalescing < 2)
+        {
+            return n;
+        }
+        
+        // the last message with a key stays (and runs in its own place); the earlier ones hang off it
+        for (size_t i = n; i-- > 0; )
+        {
+            Job* survivor = batch[i];
+            
+            if (!survivor->mCoalesce || survivor->mSuperseded)
+            {
+                continue;
+            }
+            
+            for (size_t j = i; j-- > 0; )
+            {
+                Job* earlier = batch[j];
+                
+                if (earlier->mCoalesce && !earlier->mSuperseded && earlier->mKey == survivor->mKey)
+                {
+                    earlier->mSuperseded = true;
+                    earlier->mAbsorbed = survivor->mAbsorbed;
+                    survivor->mAbsorbed = earlier;
+                }
+            }
+        }
+        
+        return n;
+    }
+    
+    // run a batch in order; false if it reached the quit message, in which case what is behind it is dropped
+    bool run_batch(Job* (&batch)[Batch], size_t n)
+    {
+        bool quit = false;
+        
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (batch[i]->mSuperseded)
+            {
+                // owned by the message that replaced it
+                continue;
+            }
+            
+            unique_ptr<Job> job{batch[i]};
+            
+            // a control message doesn't wait for the rest of the batch
+            if (quit || job->mQuit || !(mUrgent.empty() || run_urgent()))
+            {
+                quit = true;
+                continue;
+            }
+            
+            job->execute();
+            
+            for (Job* absorbed = exchange(job->mAbsorbed, nullptr); absorbed; )
+            {
+                unique_ptr<Job> replaced{absorbed};
+                absorbed = exchange(replaced->mAbsorbed, nullptr);
+                replaced->absorb();
+            }
+        }
+        
+        return !quit;
+    }
+    
+    static bool pin(int cpu)
+    {
+#ifdef __linux__
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+    
+    // one round of the runnable loop: the priority lane, the timers that are due, and a batch of the mailbox
+    // false once the actor has reached its quit message; n is the size of the batch
+    bool run_round(size_t& n)
+    {
+        Job* batch[Batch];
+        n = 0;
+        
+        if (!run_urgent())
+        {
+            return false;
+        }
+        
+        run_timers();
+        
+        n = take_batch(batch);
+        return n == 0 || run_batch(batch, n);
+    }
+    
+    // the dedicated thread
+    void run()
+    {
+        while (true)
+        {
+            size_t n{};
+            
+            if (!run_round(n))
+            {
+                return;
+            }
+            
+            if (n > 0)
+            {
+                continue;
+            }
+            
+            if (!idle())
+            {
+                // a post is halfway through
+                this_thread::yield();
+                continue;
+            }
+            
+            // the deadline is read after prepare_wait, against arm's notify after it stored one
+            uint64_t key = mEvents.prepare_wait();
+            Clock::rep deadline = mNextDeadline.load(memory_order_seq_cst);
+            
+            if (!idle() || (deadline != NoTimer && Clock::now().time_since_epoch().count() >= deadline))
+            {
+                mEvents.cancel_wait();
+            }
+            else if (deadline == NoTimer)
+            {
+                mEvents.wait(key);
+            }
+            else
+            {
+                mEvents.wait_until(key, Clock::time_point(Clock::duration(deadline)));
+            }
+        }
+    }
+    
+    // run a round on a pool thread; true if the actor has more and should be queued again
+    bool run_slice()
+    {
+        while (true)
+        {
+            size_t n{};
+            
+            mMissedWakeup.store(false, memory_order_relaxed);
+            
+            if (!run_round(n))
+            {
+                // the destructor may free this actor as soon as publish is done
+                mEvents.publish([this](){mDone.store(true, memory_order_relaxed);});
+                return false;
+            }
+            
+            if (!idle())
+            {
+                // more to come (or a post halfway through); let the others run meanwhile
+                return true;
+            }
+            
+            // let go of the strand, unless a post (or a wakeup) came in meanwhile and found it still scheduled
+            // once let go, another pool thread may be draining it already, so only the heads may be looked at
+            mScheduled.store(false, memory_order_seq_cst);
+            
+            bool more = mMailbox.posted() || mUrgent.posted() || mMissedWakeup.load(memory_order_seq_cst);
+            
+            if (!more || mScheduled.exchange(true, memory_order_seq_cst))
+            {
+                return false;
+            }
+        }
+    }
+    
+public:
+
+    // a strand of pool: messages still run one at a time and in order, but on whichever pool thread is free
+    explicit ActiveObject(ActorPool& pool) : mPool(&pool) {}
+    
+    ActiveObject()
+    {
+        mRunnable = make_unique<thread>([this](){run();});
+    }
+    
+    // a dedicated thread, pinned to cpu (where that is supported, and cpu is one we may run on; unpinned otherwise)
+    explicit ActiveObject(int cpu)
+    {
+        mRunnable = make_unique<thread>([this, cpu](){pin(cpu); run();});
+    }
+    
+    // runs what was posted before (unless the actor was told to quit already), then stops
+    ~ActiveObject() 
+    {
+        push(new QuitJob{});
+        
+        if (mRunnable)
+        {
+            mRunnable->join();
+            return;
+        }
+        
+        // a strand has no thread to join; wait for the pool to reach the quit message and let go of this actor
+        mEvents.await([this](){return mDone.load(memory_order_relaxed);});
+        mPool->forget(this);
+    }
+    
+    // a control message: the actor stops as soon as it is done with the message at hand, and whatever is still in its
+    // mailbox is dropped
+    void sendQuitMessage()
+    {
+        push(new QuitJob{}, mUrgent);
+    }
+        
+    auto func1()
+    {
+        auto l = [this]()
+        {
+            val = 1.1;
+            cout << "func1" << '\n';
+        };
+        
+        return enqueue_coalesced(Func1Key, l);
+    }
+    
+    auto func2()
+    {
+        auto l = [this]()
+        {
+            val = 2.2;
+            cout << "func2" << '\n';
+        };
+        
+        return enqueue_coalesced(Func2Key, l);
+    }
+    
+    // for a message whose result nobody waits for: no packaged_task, no future and no shared state, just a pooled node
+    // pushed onto the mailbox
+    template <
+        typename F>
+    void post(F&& f)
+    {
+        push(new PostedJob(forward<F>(f)));
+    }
+    
+    // post on the priority lane, ahead of whatever waits in the mailbox (for control messages; it is not for bulk)
+    template <
+        typename F>
+    void post_urgent(F&& f)
+    {
+        push(new PostedJob(forward<F>(f)), mUrgent);
+    }
+    
+    // post fn once delay has passed, from the actor's own loop, rather than have a thread sleep through it
+    template <
+        typename Rep,
+        typename Period,
+        typename F>
+    uint64_t post_after(chrono::duration<Rep, Period> delay, F&& fn)
+    {
+        return arm(Clock::now() + chrono::duration_cast<Clock::duration>(delay), Clock::duration::zero(), forward<F>(fn));
+    }
+    
+    // post fn every period, starting one period from now, until the timer gets cancelled
+    // the next run is due one period after the previous one was, or right away if that has passed
+    template <
+        typename Rep,
+        typename Period,
+        typename F>
+    uint64_t post_every(chrono::duration<Rep, Period> period, F&& fn)
+    {
+        auto interval = chrono::duration_cast<Clock::duration>(period);
+        
+        if (interval <= Clock::duration::zero())
+        {
+            throw invalid_argument("post_every needs a positive period");
+        }
+        
+        return arm(Clock::now() + interval, interval, forward<F>(fn));
+    }
+    
+    // returns whether the timer was still live: a one-off one that hadn't run, or a periodic one
+    // (cancelling a periodic timer from its own run ends it after that run)
+    bool cancel_timer(uint64_t id)
+    {
+        lock_guard<mutex> lk(mTimerMutex);
+        
+        if (id != 0 && id == mFiring)
+        {
+            mFiringCancelled = true;
+            return true;
+        }
+        
+        auto it = find_if(mTimers.begin(), mTimers.end(), [id](const Timer& timer){return timer.mId == id;});
+        
+        if (it == mTimers.end())
+        {
+            return false;
+        }
+        
+        mTimers.erase(it);
+        make_heap(mTimers.begin(), mTimers.end(), greater<Timer>{});
+        
+        timers_changed();
+        
+        return true;
+    }
+    
+    // for a message that only leaves its latest state behind (say, an overwrite of a field): of the messages with the
+    // same key that wait in the mailbox together, only the last one runs, and the futures of the ones it replaced become
+    // ready when it has
+    template <
+        typename F>
+    future<void> enqueue_coalesced(size_t key, F&& f)
+    {
+        auto pJob = new CoalescedJob<decay_t<F>>(key, forward<F>(f));
+        future<void> fut = pJob->get_future();
+        
+        push(pJob);
+        
+        return fut;
+    }
+    
+    template<
+        typename F,
+        typename... Args>
+    future<result_of_t<F(Args...)>> enqueue_work(F&& f, Args&&... args)
+    {
+        using RetType = result_of_t<F(Args...)>;
+        
+        packaged_task<RetType()> p(bind(forward<F>(f), forward<Args>(args)...));
+        future<RetType> fut = p.get_future();
+        
+        push(new AnyJob<RetType>(move(p)));
+        
+        return fut;
+    }
+};
+
+inline void ActorPool::wake_due()
+{
+    if (mWakeups.empty())
+    {
+        return;
+    }
+    
+    auto now = chrono::steady_clock::now();
+    
+    while (!mWakeups.empty() && mWakeups.front().first <= now)
+    {
+        ActiveObject* actor = mWakeups.front().second;
+        pop_heap(mWakeups.begin(), mWakeups.end(), greater<Wakeup>{});
+        mWakeups.pop_back();
+        
+        // claimed like a post would; under mMutex, so that forget() can't let the actor go meanwhile
+        if (!actor->mScheduled.load(memory_order_seq_cst) && !actor->mScheduled.exchange(true, memory_order_seq_cst))
+        {
+            mReady.push_back(actor);
+        }
+        else
+        {
+            actor->mMissedWakeup.store(true, memory_order_seq_cst);
+        }
+    }
+}
+
+inline void ActorPool::run()
+{
+    while (true)
+    {
+        ActiveObject* actor{};
+        {
+            unique_lock<mutex> lk(mMutex);
+            
+            while (true)
+            {
+                wake_due();
+                
+                if (mDone || !mReady.empty())
+                {
+                    break;
+                }
+                
+                if (mWakeups.empty())
+                {
+                    mCV.wait(lk);
+                }
+                else
+                {
+                    // a copy: the heap may grow (and move) while the worker sleeps
+                    TimePoint next = mWakeups.front().first;
+                    mCV.wait_until(lk, next);
+                }
+            }
+            
+            if (mReady.empty())
+            {
+                return;
+            }
+            
+            actor = mReady.front(); mReady.pop_front();
+        }
+        
+        if (actor->run_slice())
+        {
+            schedule(actor);
+        }
+    }
+}
+
+// N actors, each owning a part of the keys: a key always goes to the same actor, so the messages for one key keep their
+// order, while different keys spread over all N of them, each on a thread pinned to a cpu of its own
+// keys are placed with a jump consistent hash, so that going from N to N + 1 actors moves only 1/(N + 1) of them
+template <
+    size_t N>
+class ActiveObjectGroup
+{
+    static_assert(N > 0, "an ActiveObjectGroup needs at least one actor");
+    
+    // the outcome of a broadcast: a slot per actor, and the first exception, if any
+    template <
+        typename RetType>
+    struct Gather
+    {
+        using Slot = conditional_t<is_void_v<RetType>, bool, optional<RetType>>;
+        using Result = conditional_t<is_void_v<RetType>, void, vector<RetType>>;
+        
+        array<Slot, N> mResults{};
+        atomic<size_t> mRemaining{N};
+        mutex mMutex{};
+        exception_ptr mException{};
+        promise<Result> mPromise{};
+        
+        template <
+            typename F>
+        void run(F& fn, size_t i)
+        {
+            try
+            {
+                if constexpr (is_void_v<RetType>)
+                {
+                    fn(i);
+                }
+                else
+                {
+                    mResults[i].emplace(fn(i));
+                }
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lk(mMutex);
+                if (!mException)
+                {
+                    mException = current_exception();
+                }
+            }
+            
+            // the last one to finish hands over the lot
+            if (mRemaining.fetch_sub(1, memory_order_acq_rel) != 1)
+            {
+                return;
+            }
+            
+            if (mException)
+            {
+                mPromise.set_exception(mException);
+            }
+            else if constexpr (is_void_v<RetType>)
+            {
+                mPromise.set_value();
+            }
+            else
+            {
+                vector<RetType> results;
+                results.reserve(N);
+                for (auto& slot : mResults)
+                {
+                    results.push_back(move(*slot));
+                }
+                
+                mPromise.set_value(move(results));
+            }
+        }
+    };
+    
+    array<unique_ptr<ActiveObject>, N> mActors{};
+    
+    static vector<int> allowed_cpus()
+    {
+        vector<int> cpus;
+        
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int i = 0; i < CPU_SETSIZE; ++i)
+            {
+                if (CPU_ISSET(i, &set))
+                {
+                    cpus.push_back(i);
+                }
+            }
+        }
+#endif
+        
+        if (cpus.empty())
+        {
+            for (int i = 0; i < max(static_cast<int>(thread::hardware_concurrency()), 1); ++i)
+            {
+                cpus.push_back(i);
+            }
+        }
+        
+        return cpus;
+    }
+    
+    // Lamping and Veach, "A Fast, Minimal Memory, Consistent Hash Algorithm"
+    static size_t jump_hash(uint64_t key)
+    {
+        int64_t b = -1;
+        int64_t j = 0;
+        
+        while (j < static_cast<int64_t>(N))
+        {
+            b = j;
+            key = key * 2862933555777941757ULL + 1;
+            j = static_cast<int64_t>((b + 1) * (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
+        }
+        
+        return static_cast<size_t>(b);
+    }
+    
+public:
+
+    // the actors go to the cpus we may run on, round robin, starting with the firstCpu'th of them
+    // (with more actors than cpus, some share one)
+    explicit ActiveObjectGroup(size_t firstCpu = 0)
+    {
+        vector<int> cpus = allowed_cpus();
+        
+        for (size_t i = 0; i < N; ++i)
+        {
+            mActors[i] = make_unique<ActiveObject>(cpus[(firstCpu + i) % cpus.size()]);
+        }
+    }
+    
+    static constexpr size_t size()
+    {
+        return N;
+    }
+    
+    // the actor that owns key
+    template <
+        typename Key>
+    size_t shard(const Key& key) const
+    {
+        return jump_hash(hash<Key>{}(key));
+    }
+    
+    ActiveObject& operator[](size_t i)
+    {
+        return *mActors[i];
+    }
+    
+    template <
+        typename Key>
+    ActiveObject& actor(const Key& key)
+    {
+        return *mActors[shard(key)];
+    }
+    
+    template <
+        typename Key,
+        typename F>
+    void post(const Key& key, F&& fn)
+    {
+        actor(key).post(forward<F>(fn));
+    }
+    
+    // scatter: run fn(i) on every actor i; gather: a future of the N results, in actor order, that becomes ready when the
+    // last of them is done (or that carries the first exception any of them threw)
+    template <
+        typename F>
+    auto broadcast(F fn)
+    {
+        using RetType = invoke_result_t<F&, size_t>;
+        
+        auto gather = make_shared<Gather<RetType>>();
+        auto fut = gather->mPromise.get_future();
+        
+        for (size_t i = 0; i < N; ++i)
+        {
+            mActors[i]->post([gather, fn, i]() mutable {gather->run(fn, i);});
+        }
+        
+        return fut;
+    }
+};
+
+// the demo; a program that includes this file for the ActiveObject (say, the benchmark driver) defines ACTIVE_OBJECT_NO_MAIN
+#ifndef ACTIVE_OBJECT_NO_MAIN
+int main()
+{
+    ActiveObject ao{};
+    ao.func1();
+    ao.func2();
+    
+    {
+        // ten thousand actors on two threads
+        atomic<int> count{};
+        ActorPool pool{2};
+        
+        vector<unique_ptr<ActiveObject>> actors;
+        for (int i = 0; i < 10000; ++i)
+        {
+            actors.push_back(make_unique<ActiveObject>(pool));
+        }
+        
+        for (auto& actor : actors)
+        {
+            actor->post([&count](){++count;});
+        }
+        
+        actors.clear();
+        cout << "strands: " << count << '\n';
+    }
+    
+    {
+        // housekeeping from the actor's own loop, and a quit that doesn't wait for the backlog
+        atomic<int> beats{};
+        ActiveObject actor{};
+        
+        uint64_t heartbeat = actor.post_every(chrono::milliseconds(10), [&beats](){++beats;});
+        actor.post_after(chrono::milliseconds(50), [](){cout << "after 50ms" << '\n';});
+        this_thread::sleep_for(chrono::milliseconds(105));
+        actor.cancel_timer(heartbeat);
+        cout << "heartbeats: " << (beats >= 5) << '\n';
+        
+        for (int i = 0; i < 1000; ++i)
+        {
+            actor.post([](){this_thread::sleep_for(chrono::milliseconds(1));});
+        }
+        
+        auto start = chrono::steady_clock::now();
+        actor.post_urgent([start](){cout << "urgent within 100ms: " << (chrono::steady_clock::now() - start < chrono::milliseconds(100)) << '\n';});
+        actor.sendQuitMessage();
+    }
+    
+    {
+        // a running sum per key range: each actor owns the sums of its keys, so nothing is shared
+        ActiveObjectGroup<4> group{};
+        array<long, 4> sums{};
+        
+        for (long key = 1; key <= 1000; ++key)
+        {
+            size_t shard = group.shard(key);
+            group.post(key, [&sums, shard, key](){sums[shard] += key;});
+        }
+        
+        vector<long> partial = group.broadcast([&sums](size_t i){return sums[i];}).get();
+        cout << "group: " << accumulate(partial.begin(), partial.end(), 0L) << '\n';
+    }
     
     return 0;
 }
+#endif
@@ -0,0 +1,469 @@
+// microbenchmarks for the ThreadPool and the ActiveObject
+//
+// needs nothing but a compiler:
+//     g++ -std=c++17 -O2 -pthread Utilities/Benchmark/Benchmark.cpp -o benchmark
+//     ./benchmark [--format csv|json] [--out FILE] [--workers N] [--producers N] [--variant NAME] [--quick]
+//
+// every measurement is one row (benchmark, variant, workers, producers, metric, value, unit), written as CSV (the
+// default) or as a JSON array, so that two runs (two scheduler variants, or a change and its baseline) can be diffed
+// the pool and the actors chat on cout; that goes to stderr, so that only the results end up on stdout
+
+#define THREAD_POOL_NO_MAIN
+#include "../ThreadPool.cpp"
+
+#define ACTIVE_OBJECT_NO_MAIN
+#include "../ActiveObject.cpp"
+
+#include <cstring>
+
+struct Result
+{
+    string benchmark;
+    string variant;
+    int workers;
+    int producers;
+    string metric;
+    double value;
+    string unit;
+};
+
+struct Settings
+{
+    string format{"csv"};
+    string out{};
+    string variant{};
+    int workers = max(static_cast<int>(thread::hardware_concurrency()), 1);
+    int producers = max(static_cast<int>(thread::hardware_concurrency()), 1);
+    bool quick{false};
+
+    // scaled down by --quick
+    size_t scale(size_t n) const
+    {
+        return quick ? max<size_t>(n / 10, 1) : n;
+    }
+};
+
+using Clock = chrono::steady_clock;
+
+double nanos_since(Clock::time_point start)
+{
+    return chrono::duration<double, nano>(Clock::now() - start).count();
+}
+
+// busy waits for a flag raised by a task; yields, since there may be fewer cpus than threads
+void await(const atomic<bool>& flag)
+{
+    while (!flag.load(memory_order_acquire))
+    {
+        this_thread::yield();
+    }
+}
+
+void await_zero(const atomic<long>& counter)
+{
+    while (counter.load(memory_order_acquire) != 0)
+    {
+        this_thread::yield();
+    }
+}
+
+// p in [0, 1], of samples sorted in ascending order
+double percentile(const vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+
+    size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[min(index, sorted.size() - 1)];
+}
+
+void add_percentiles(vector<Result>& results, const Result& proto, vector<double> samples)
+{
+    sort(samples.begin(), samples.end());
+
+    for (auto [label, p] : {pair{"p50", 0.5}, pair{"p90", 0.9}, pair{"p99", 0.99}, pair{"p999", 0.999}, pair{"max", 1.0}})
+    {
+        Result result = proto;
+        result.metric += string("_") + label;
+        result.value = percentile(samples, p);
+        results.push_back(result);
+    }
+}
+
+// one external producer submits empty tasks as fast as it can
+template <
+    typename Pool>
+void empty_task_throughput(Pool& tp, const Settings& settings, const string& variant, vector<Result>& results)
+{
+    long numTasks = static_cast<long>(settings.scale(1000000));
+
+    atomic<long> remaining{numTasks};
+    auto start = Clock::now();
+
+    for (long i = 0; i < numTasks; ++i)
+    {
+        tp.enqueue_task([&remaining](){remaining.fetch_sub(1, memory_order_release);});
+    }
+
+    await_zero(remaining);
+    double elapsed = nanos_since(start);
+
+    results.push_back({"empty_task", variant, tp.num_workers(), 1, "throughput", numTasks / elapsed * 1e9, "tasks/s"});
+    results.push_back({"empty_task", variant, tp.num_workers(), 1, "cost", elapsed / numTasks, "ns/task"});
+}
+
+// the time from enqueue_task() to the task starting
+// hot : one after the other, with the workers still spinning from the previous task
+// cold: with a pause in between, so that the workers have parked and need to be woken up
+template <
+    typename Pool>
+void submit_to_start_latency(Pool& tp, const Settings& settings, const string& variant, vector<Result>& results)
+{
+    for (bool cold : {false, true})
+    {
+        size_t numSamples = settings.scale(cold ? 2000 : 20000);
+        vector<double> samples(numSamples);
+
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            if (cold)
+            {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+
+            atomic<bool> started{false};
+            auto submitted = Clock::now();
+
+            tp.enqueue_task(
+                [&samples, &started, submitted, i]()
+                {
+                    samples[i] = nanos_since(submitted);
+                    started.store(true, memory_order_release);
+                });
+
+            await(started);
+        }
+
+        add_percentiles(results, {"submit_to_start", variant, tp.num_workers(), 1, cold ? "cold" : "hot", 0.0, "ns"}, move(samples));
+    }
+}
+
+// fan out a number of empty tasks and wait for all of them, over and over
+template <
+    typename Pool>
+void fan_out_fan_in(Pool& tp, const Settings& settings, const string& variant, vector<Result>& results)
+{
+    for (size_t width : {16, 256})
+    {
+        size_t numRounds = settings.scale(width == 16 ? 20000 : 2000);
+        vector<int> elements(width);
+
+        auto start = Clock::now();
+        for (size_t round = 0; round < numRounds; ++round)
+        {
+            tp.enqueue_batch(elements, [](int){}).get();
+        }
+        double batch = nanos_since(start) / numRounds;
+
+        start = Clock::now();
+        for (size_t round = 0; round < numRounds; ++round)
+        {
+            task_group group{tp};
+            for (size_t i = 0; i < width; ++i)
+            {
+                group.run([](){});
+            }
+            group.wait();
+        }
+        double group = nanos_since(start) / numRounds;
+
+        string suffix = "_" + to_string(width);
+        results.push_back({"fan_out_fan_in", variant, tp.num_workers(), 1, "enqueue_batch" + suffix, batch, "ns/round"});
+        results.push_back({"fan_out_fan_in", variant, tp.num_workers(), 1, "task_group" + suffix, group, "ns/round"});
+    }
+}
+
+// 1, 2, 4, ... producers submitting empty tasks at the same time
+template <
+    typename Pool>
+void producer_contention(Pool& tp, const Settings& settings, const string& variant, vector<Result>& results)
+{
+    long numTasks = static_cast<long>(settings.scale(400000));
+
+    for (int numProducers = 1; ; numProducers = min(numProducers * 2, settings.producers))
+    {
+        atomic<long> remaining{numTasks};
+        atomic<bool> go{false};
+
+        vector<thread> producers;
+        for (int p = 0; p < numProducers; ++p)
+        {
+            long share = numTasks / numProducers + (p < numTasks % numProducers ? 1 : 0);
+
+            producers.emplace_back(
+                [&tp, &remaining, &go, share]()
+                {
+                    await(go);
+                    for (long i = 0; i < share; ++i)
+                    {
+                        tp.enqueue_task([&remaining](){remaining.fetch_sub(1, memory_order_release);});
+                    }
+                });
+        }
+
+        auto start = Clock::now();
+        go.store(true, memory_order_release);
+
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+        await_zero(remaining);
+
+        double elapsed = nanos_since(start);
+        results.push_back({"producer_contention", variant, tp.num_workers(), numProducers, "throughput", numTasks / elapsed * 1e9, "tasks/s"});
+
+        if (numProducers == settings.producers)
+        {
+            break;
+        }
+    }
+}
+
+template <
+    typename Discipline>
+void run_variant(const string& name, scheduling mode, const Settings& settings, vector<Result>& results)
+{
+    if (!settings.variant.empty() && settings.variant != name)
+    {
+        return;
+    }
+
+    cerr << "benchmarking " << name << '\n';
+
+    ThreadPool<Discipline> tp{settings.workers, mode};
+
+    // warm up (threads spinning, slabs and queues grown)
+    for (int i = 0; i < 10000; ++i)
+    {
+        tp.enqueue_task([](){});
+    }
+    tp.enqueue_task([](){}).get();
+
+    empty_task_throughput(tp, settings, name, results);
+    submit_to_start_latency(tp, settings, name, results);
+    fan_out_fan_in(tp, settings, name, results);
+    producer_contention(tp, settings, name, results);
+}
+
+// two actors bouncing a message back and forth: A's handler posts to B, whose handler posts back to A
+struct PingPong
+{
+    ActiveObject& mA;
+    ActiveObject& mB;
+    long mRemaining;
+    promise<void> mDone{};
+
+    void ping()
+    {
+        if (mRemaining-- == 0)
+        {
+            mDone.set_value();
+            return;
+        }
+
+        mB.post([this](){pong();});
+    }
+
+    void pong()
+    {
+        mA.post([this](){ping();});
+    }
+};
+
+void active_object_ping_pong(ActiveObject& a, ActiveObject& b, const Settings& settings, const string& variant, vector<Result>& results)
+{
+    long numRoundTrips = static_cast<long>(settings.scale(100000));
+
+    PingPong pingPong{a, b, numRoundTrips};
+    future<void> done = pingPong.mDone.get_future();
+
+    auto start = Clock::now();
+    a.post([&pingPong](){pingPong.ping();});
+    done.get();
+
+    results.push_back({"active_object", variant, 1, 1, "ping_pong", nanos_since(start) / numRoundTrips, "ns/round_trip"});
+
+    // one producer posting to one actor, fire-and-forget, and with a future per message
+    long numMessages = static_cast<long>(settings.scale(1000000));
+
+    for (bool withFuture : {false, true})
+    {
+        atomic<long> remaining{numMessages};
+        start = Clock::now();
+
+        for (long i = 0; i < numMessages; ++i)
+        {
+            auto l = [&remaining](){remaining.fetch_sub(1, memory_order_release);};
+
+            if (withFuture)
+            {
+                a.enqueue_work(l);
+            }
+            else
+            {
+                a.post(l);
+            }
+        }
+
+        await_zero(remaining);
+        double elapsed = nanos_since(start);
+        results.push_back({"active_object", variant, 1, 1, withFuture ? "enqueue_work" : "post", numMessages / elapsed * 1e9, "messages/s"});
+    }
+
+    // a request from outside, and the wait for its reply
+    size_t numSamples = settings.scale(20000);
+    vector<double> samples(numSamples);
+
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        auto sent = Clock::now();
+        a.enqueue_work([](){}).get();
+        samples[i] = nanos_since(sent);
+    }
+
+    add_percentiles(results, {"active_object", variant, 1, 1, "request_reply", 0.0, "ns"}, move(samples));
+}
+
+// the actors on their own threads, and as strands of a shared ActorPool
+void active_object(const Settings& settings, vector<Result>& results)
+{
+    if (!settings.variant.empty() && settings.variant != "active_object")
+    {
+        return;
+    }
+
+    cerr << "benchmarking active_object" << '\n';
+
+    {
+        ActiveObject a{};
+        ActiveObject b{};
+        active_object_ping_pong(a, b, settings, "thread", results);
+    }
+
+    {
+        ActorPool pool{settings.workers};
+        ActiveObject a{pool};
+        ActiveObject b{pool};
+        active_object_ping_pong(a, b, settings, "strand", results);
+    }
+}
+
+void write_csv(ostream& os, const vector<Result>& results)
+{
+    os << "benchmark,variant,workers,producers,metric,value,unit" << '\n';
+
+    for (const Result& r : results)
+    {
+        os << r.benchmark << ',' << r.variant << ',' << r.workers << ',' << r.producers << ','
+           << r.metric << ',' << r.value << ',' << r.unit << '\n';
+    }
+}
+
+void write_json(ostream& os, const vector<Result>& results)
+{
+    os << "[" << '\n';
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        os << "  {\"benchmark\": \"" << r.benchmark << "\", \"variant\": \"" << r.variant
+           << "\", \"workers\": " << r.workers << ", \"producers\": " << r.producers
+           << ", \"metric\": \"" << r.metric << "\", \"value\": " << r.value << ", \"unit\": \"" << r.unit << "\"}"
+           << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+
+    os << "]" << '\n';
+}
+
+int main(int argc, char* argv[])
+{
+    Settings settings{};
+
+    for (int i = 1; i < argc; ++i)
+    {
+        auto value = [&]() -> string
+        {
+            if (i + 1 >= argc)
+            {
+                cerr << "missing value for " << argv[i] << '\n';
+                exit(2);
+            }
+            return argv[++i];
+        };
+
+        if (!strcmp(argv[i], "--format"))
+        {
+            settings.format = value();
+        }
+        else if (!strcmp(argv[i], "--out"))
+        {
+            settings.out = value();
+        }
+        else if (!strcmp(argv[i], "--variant"))
+        {
+            settings.variant = value();
+        }
+        else if (!strcmp(argv[i], "--workers"))
+        {
+            settings.workers = max(stoi(value()), 1);
+        }
+        else if (!strcmp(argv[i], "--producers"))
+        {
+            settings.producers = max(stoi(value()), 1);
+        }
+        else if (!strcmp(argv[i], "--quick"))
+        {
+            settings.quick = true;
+        }
+        else
+        {
+            cerr << "usage: " << argv[0]
+                 << " [--format csv|json] [--out FILE] [--workers N] [--producers N] [--variant NAME] [--quick]" << '\n'
+                 << "variants: fifo, fifo_work_stealing, lifo, priority_aging, deadline_lanes, bounded_mpmc, active_object" << '\n';
+            return 2;
+        }
+    }
+
+    // results go to stdout (or --out); everything else to stderr
+    ostream results_stream(cout.rdbuf());
+    cout.rdbuf(cerr.rdbuf());
+
+    vector<Result> results;
+
+    run_variant<fifo>("fifo", scheduling::shared_queue, settings, results);
+    run_variant<fifo>("fifo_work_stealing", scheduling::work_stealing, settings, results);
+    run_variant<lifo>("lifo", scheduling::shared_queue, settings, results);
+    run_variant<priority_aging<>>("priority_aging", scheduling::shared_queue, settings, results);
+    run_variant<deadline_lanes>("deadline_lanes", scheduling::shared_queue, settings, results);
+    run_variant<bounded_mpmc<4096, backpressure::block>>("bounded_mpmc", scheduling::shared_queue, settings, results);
+    active_object(settings, results);
+
+    ofstream file;
+    ostream& os = settings.out.empty() ? results_stream : (file.open(settings.out), file);
+
+    if (settings.format == "json")
+    {
+        write_json(os, results);
+    }
+    else
+    {
+        write_csv(os, results);
+    }
+
+    cout.rdbuf(results_stream.rdbuf());
+
+    return 0;
+}
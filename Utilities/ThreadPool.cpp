@@ -3,155 +3,5012 @@
 #include <thread>
 #include <future>
 #include <mutex>
+#include <atomic>
 #include <iostream>
 #include <condition_variable>
 #include <functional>
 #include <memory>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <exception>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <cstdint>
+#include <optional>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+// build with -DTHREAD_POOL_TELEMETRY to have the pool record queue wait and run time histograms and a few counters
+// (see ThreadPool::stats()); without it, none of that gets compiled in
+#if defined(THREAD_POOL_TELEMETRY) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
 
 using namespace std;
 
-class ThreadPool
+// a move-only, type erased void() callable
+// callables up to InlineSize bytes (that are nothrow movable) live inside the task itself, so no heap allocation is needed
+// bigger callables fall back to the heap
+//
+// a task that is not going to be run after all (say, a full queue turned it down) gets *abandoned* with the reason why
+// a callable with an abandon(exception_ptr) member gets to react to that (say, fail the future its caller waits on)
+// any other callable just gets destroyed
+class Task
+{
+    template <typename F, typename = void_t<>>
+    struct has_abandon : false_type
+    {};
+    
+    template <typename F>
+    struct has_abandon<F, void_t<decltype(declval<F&>().abandon(declval<exception_ptr>()))>> : true_type
+    {};
+    
+    // glues a run callable and an abandon callable together
+    template <
+        typename Run,
+        typename OnAbandon>
+    struct WithAbandon
+    {
+        Run mRun;
+        OnAbandon mOnAbandon;
+        
+        void operator()()
+        {
+            mRun();
+        }
+        
+        void abandon(exception_ptr e)
+        {
+            mOnAbandon(move(e));
+        }
+    };
+    
+    static constexpr size_t InlineSize = 64;
+    
+    template <typename F>
+    static constexpr bool fits_inline = 
+        sizeof(F) <= InlineSize && alignof(F) <= alignof(max_align_t) && is_nothrow_move_constructible_v<F>;
+    
+    enum class Op
+    {
+        move,
+        destroy
+    };
+    
+    alignas(max_align_t) unsigned char mStorage[InlineSize];
+    
+    // a few plain function pointers (rather than a vtable) per callable type
+    void (*mInvoke)(Task&){nullptr};
+    void (*mManage)(Op, Task&, Task*){nullptr};
+    void (*mAbandon)(Task&, exception_ptr){nullptr};
+    
+#ifdef THREAD_POOL_TELEMETRY
+    // when the task got queued (a cycle_clock timestamp)
+    uint64_t mQueuedAt{0};
+#endif
+    
+    template <typename F>
+    F* target()
+    {
+        if constexpr (fits_inline<F>)
+        {
+            return std::launder(reinterpret_cast<F*>(mStorage));
+        }
+        else
+        {
+            return *reinterpret_cast<F**>(mStorage);
+        }
+    }
+    
+    template <typename F>
+    static void invoke(Task& self)
+    {
+        (*self.target<F>())();
+    }
+    
+    template <typename F>
+    static void abandon(Task& self, exception_ptr e)
+    {
+        self.target<F>()->abandon(move(e));
+    }
+    
+    // Op::move    : move the callable from *self* into the (empty) *other*
+    // Op::destroy : destroy the callable in *self*
+    template <typename F>
+    static void manage(Op op, Task& self, Task* other)
+    {
+        if constexpr (fits_inline<F>)
+        {
+            if (op == Op::move)
+            {
+                ::new (static_cast<void*>(other->mStorage)) F(std::move(*self.target<F>()));
+            }
+            
+            self.target<F>()->~F();
+        }
+        else
+        {
+            if (op == Op::move)
+            {
+                ::new (static_cast<void*>(other->mStorage)) F*(self.target<F>());
+            }
+            else
+            {
+                delete self.target<F>();
+            }
+        }
+    }
+    
+    void reset() noexcept
+    {
+        if (mManage)
+        {
+            mManage(Op::destroy, *this, nullptr);
+            mInvoke = nullptr;
+            mManage = nullptr;
+            mAbandon = nullptr;
+        }
+    }
+    
+public:
+
+    Task() = default;
+    
+    template <
+        typename F,
+        typename Fn = decay_t<F>,
+        typename = enable_if_t<!is_same_v<Fn, Task>>>
+    Task(F&& f)
+    : mInvoke(&invoke<Fn>), mManage(&manage<Fn>)
+    {
+        if constexpr (has_abandon<Fn>::value)
+        {
+            mAbandon = &abandon<Fn>;
+        }
+        
+        if constexpr (fits_inline<Fn>)
+        {
+            ::new (static_cast<void*>(mStorage)) Fn(std::forward<F>(f));
+        }
+        else
+        {
+            ::new (static_cast<void*>(mStorage)) Fn*(new Fn(std::forward<F>(f)));
+        }
+    }
+    
+    // a task that runs *run*, or calls onAbandon(reason) if abandoned
+    template <
+        typename Run,
+        typename OnAbandon>
+    Task(Run&& run, OnAbandon&& onAbandon)
+    : Task(WithAbandon<decay_t<Run>, decay_t<OnAbandon>>{forward<Run>(run), forward<OnAbandon>(onAbandon)}) {}
+    
+    // move enabled
+    Task(Task&& rhs) noexcept
+    {
+        *this = std::move(rhs);
+    }
+    
+    Task& operator=(Task&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            reset();
+            
+            if (rhs.mManage)
+            {
+                rhs.mManage(Op::move, rhs, this);
+                mInvoke = rhs.mInvoke;
+                mManage = rhs.mManage;
+                mAbandon = rhs.mAbandon;
+                rhs.mInvoke = nullptr;
+                rhs.mManage = nullptr;
+                rhs.mAbandon = nullptr;
+            }
+            
+#ifdef THREAD_POOL_TELEMETRY
+            mQueuedAt = rhs.mQueuedAt;
+#endif
+        }
+        
+        return *this;
+    }
+    
+    // copy disabled
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    
+    ~Task() noexcept
+    {
+        reset();
+    }
+    
+    explicit operator bool() const
+    {
+        return mInvoke != nullptr;
+    }
+    
+    void operator()()
+    {
+        mInvoke(*this);
+    }
+    
+#ifdef THREAD_POOL_TELEMETRY
+    void set_queued_at(uint64_t timestamp)
+    {
+        mQueuedAt = timestamp;
+    }
+    
+    uint64_t queued_at() const
+    {
+        return mQueuedAt;
+    }
+#endif
+    
+    // give up on the task without running it
+    void abandon(exception_ptr reason)
+    {
+        if (mAbandon)
+        {
+            mAbandon(*this, move(reason));
+        }
+        
+        reset();
+    }
+};
+
+// a recyclable pool of Node objects (Node must provide a *Node* mNextFree* link)
+// each thread keeps a private free list, so acquire/release are plain pointer operations
+// a thread holding too many nodes (say, a worker releasing the states of the tasks it ran) hands a batch over to
+// a global free list, wherefrom a thread running short (say, a submitter) picks up a batch
+// nodes are never given back to the heap, so in steady state there are no allocations at all
+template <
+    typename Node>
+class Slab
+{
+    static constexpr size_t BatchSize = 64;
+    
+    struct Global
+    {
+        mutex mMutex{};
+        vector<pair<Node*, size_t>> mBatches{};
+        vector<unique_ptr<Node[]>> mChunks{};
+    };
+    
+    struct Local
+    {
+        Node* mHead{nullptr};
+        size_t mCount{0};
+        
+        // the global free list must outlive every thread local one
+        Global& mGlobal{global()};
+        
+        // when a thread exits, its nodes become available to the other threads
+        ~Local()
+        {
+            if (mHead)
+            {
+                unique_lock<mutex> lk(mGlobal.mMutex);
+                mGlobal.mBatches.emplace_back(mHead, mCount);
+            }
+        }
+    };
+    
+    static Global& global()
+    {
+        static Global g{};
+        return g;
+    }
+    
+    static Local& local()
+    {
+        static thread_local Local l{};
+        return l;
+    }
+    
+    static void refill(Local& l)
+    {
+        Global& g = l.mGlobal;
+        unique_lock<mutex> lk(g.mMutex);
+        
+        if (!g.mBatches.empty())
+        {
+            tie(l.mHead, l.mCount) = g.mBatches.back(); g.mBatches.pop_back();
+            return;
+        }
+        
+        g.mChunks.emplace_back(make_unique<Node[]>(BatchSize));
+        Node* chunk = g.mChunks.back().get();
+        
+        for (size_t i = 0; i < BatchSize; ++i)
+        {
+            chunk[i].mNextFree = (i + 1 < BatchSize) ? &chunk[i + 1] : nullptr;
+        }
+        
+        l.mHead = chunk;
+        l.mCount = BatchSize;
+    }
+    
+public:
+
+    static Node* acquire()
+    {
+        Local& l = local();
+        
+        if (!l.mHead)
+        {
+            refill(l);
+        }
+        
+        Node* node = l.mHead;
+        l.mHead = node->mNextFree;
+        --l.mCount;
+        
+        return node;
+    }
+    
+    static void release(Node* node)
+    {
+        Local& l = local();
+        
+        node->mNextFree = l.mHead;
+        l.mHead = node;
+        ++l.mCount;
+        
+        // keep one batch around locally, hand the other one over
+        if (l.mCount == 2 * BatchSize)
+        {
+            Node* batch = l.mHead;
+            
+            // find the last node of the batch that starts at the head
+            node = batch;
+            for (size_t i = 1; i < BatchSize; ++i)
+            {
+                node = node->mNextFree;
+            }
+            
+            l.mHead = node->mNextFree;
+            l.mCount -= BatchSize;
+            node->mNextFree = nullptr;
+            
+            unique_lock<mutex> lk(l.mGlobal.mMutex);
+            l.mGlobal.mBatches.emplace_back(batch, BatchSize);
+        }
+    }
+};
+
+// where the continuations of a future run, typically the pool that runs the task behind the future
+// type erased, so that futures stay independent of the pool's discipline
+// without a scheduler, continuations run inline on the thread that completes the future
+struct Executor
+{
+    void* mContext{nullptr};
+    void (*mSchedule)(void*, Task){nullptr};
+    
+    void execute(Task task) const
+    {
+        if (mSchedule)
+        {
+            mSchedule(mContext, std::move(task));
+        }
+        else
+        {
+            task();
+        }
+    }
+};
+
+template <typename>
+class Promise;
+
+// the state shared between a Promise and a Future
+// reference counted (one reference each for the promise and the future) and recycled via the Slab
+template <
+    typename T>
+class SharedState
+{
+    template <typename>
+    friend class Slab;
+    
+    template <typename>
+    friend class Promise;
+    
+    template <typename>
+    friend class Future;
+    
+    using ValueType = conditional_t<is_void_v<T>, char, T>;
+    
+    SharedState* mNextFree{nullptr};
+    
+    atomic<int> mRefs{0};
+    atomic<bool> mReady{false};
+    
+    // a waiter only ever touches the mutex/condition variable if the result is not ready yet
+    mutex mMutex{};
+    condition_variable mCV{};
+    
+    bool mHasValue{false};
+    alignas(ValueType) unsigned char mValue[sizeof(ValueType)];
+    exception_ptr mException{};
+    
+    // at most one callback, run by whoever makes the state ready (or attaches the callback late)
+    // guarded by mMutex until the state is ready
+    Task mContinuation{};
+    Executor mExecutor{};
+    
+    static SharedState* create()
+    {
+        SharedState* state = Slab<SharedState>::acquire();
+        state->mRefs.store(2, memory_order_relaxed);
+        state->mReady.store(false, memory_order_relaxed);
+        state->mExecutor = Executor{};
+        return state;
+    }
+    
+    void release()
+    {
+        if (mRefs.fetch_sub(1, memory_order_acq_rel) == 1)
+        {
+            if (mHasValue)
+            {
+                value().~ValueType();
+                mHasValue = false;
+            }
+            
+            mException = nullptr;
+            Slab<SharedState>::release(this);
+        }
+    }
+    
+    ValueType& value()
+    {
+        return *std::launder(reinterpret_cast<ValueType*>(mValue));
+    }
+    
+    void make_ready()
+    {
+        Task continuation;
+        
+        {
+            unique_lock<mutex> lk(mMutex);
+            mReady.store(true, memory_order_release);
+            continuation = std::move(mContinuation);
+        }
+        
+        mCV.notify_all();
+        
+        // the fulfilling promise still holds a reference, so the state outlives the callback
+        if (continuation)
+        {
+            continuation();
+        }
+    }
+    
+    void set_continuation(Task continuation)
+    {
+        if (!mReady.load(memory_order_acquire))
+        {
+            unique_lock<mutex> lk(mMutex);
+            
+            if (!mReady.load(memory_order_relaxed))
+            {
+                mContinuation = std::move(continuation);
+                return;
+            }
+        }
+        
+        // already ready: nobody else is going to run it
+        continuation();
+    }
+    
+    void wait()
+    {
+        if (!mReady.load(memory_order_acquire))
+        {
+            unique_lock<mutex> lk(mMutex);
+            mCV.wait(lk, [this](){return mReady.load(memory_order_acquire);});
+        }
+    }
+};
+
+template <
+    typename T>
+class Future
 {
-    // a generic job
-    class Job
+    template <typename>
+    friend class Promise;
+    
+    SharedState<T>* mState{nullptr};
+    
+    explicit Future(SharedState<T>* state) : mState(state) {}
+    
+public:
+
+    Future() = default;
+    
+    // move enabled
+    Future(Future&& rhs) noexcept : mState(exchange(rhs.mState, nullptr)) {}
+    
+    Future& operator=(Future&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (mState)
+            {
+                mState->release();
+            }
+            
+            mState = exchange(rhs.mState, nullptr);
+        }
+        
+        return *this;
+    }
+    
+    // copy disabled
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+    
+    ~Future() noexcept
+    {
+        if (mState)
+        {
+            mState->release();
+        }
+    }
+    
+    bool valid() const
+    {
+        return mState != nullptr;
+    }
+    
+    bool is_ready() const
+    {
+        return mState->mReady.load(memory_order_acquire);
+    }
+    
+    void wait() const
+    {
+        mState->wait();
+    }
+    
+    Executor executor() const
+    {
+        return mState->mExecutor;
+    }
+    
+    // like std::future::get(), the result may be retrieved just once
+    T get()
+    {
+        SharedState<T>* state = exchange(mState, nullptr);
+        state->wait();
+        
+        // release the state even if we are about to rethrow
+        unique_ptr<SharedState<T>, void(*)(SharedState<T>*)> guard(state, [](SharedState<T>* s){s->release();});
+        
+        if (state->mException)
+        {
+            rethrow_exception(state->mException);
+        }
+        
+        if constexpr (!is_void_v<T>)
+        {
+            return std::move(state->value());
+        }
+    }
+    
+#ifdef __cpp_impl_coroutine
+    // co_await a future: the coroutine suspends until the result is in, and gets resumed by whoever completes
+    // the future (for a pool future, the worker that ran the task) without any allocation
+    auto operator co_await() &&
+    {
+        struct Awaiter
+        {
+            Future mFuture;
+            
+            bool await_ready() const
+            {
+                return mFuture.is_ready();
+            }
+            
+            void await_suspend(coroutine_handle<> h)
+            {
+                // may resume the coroutine (and destroy this awaiter) before it returns
+                mFuture.on_ready([this, h](Future ready)
+                {
+                    mFuture = std::move(ready);
+                    h.resume();
+                });
+            }
+            
+            T await_resume()
+            {
+                return mFuture.get();
+            }
+        };
+        
+        return Awaiter{std::move(*this)};
+    }
+#endif
+    
+    // hand the (ready) future over to *callback* once the result is in, without blocking anybody
+    // the callback runs on the thread that completes the future (or right here if that already happened),
+    // so it should be short; this future is left invalid
+    template <
+        typename F>
+    void on_ready(F&& callback)
+    {
+        SharedState<T>* state = exchange(mState, nullptr);
+        
+        state->set_continuation(Task([state, callback = decay_t<F>(std::forward<F>(callback))]() mutable
+        {
+            callback(Future(state));
+        }));
+    }
+    
+    // schedule fn(result) on the executor of this future (the pool behind it) once the result is in
+    // if this future fails, fn is skipped and the returned future fails the same way
+    // this future is left invalid
+    template <
+        typename F>
+    auto then(F&& fn)
+    {
+        using Fn = decay_t<F>;
+        using RetType = typename conditional_t<is_void_v<T>, invoke_result<Fn&>, invoke_result<Fn&, T>>::type;
+        
+        Executor executor = this->executor();
+        
+        Promise<RetType> promise;
+        promise.set_executor(executor);
+        Future<RetType> future = promise.get_future();
+        
+        on_ready([executor, promise = std::move(promise), fn = Fn(std::forward<F>(fn))](Future ready) mutable
+        {
+            executor.execute(Task(Continuation<RetType, Fn>{std::move(ready), std::move(promise), std::move(fn)}));
+        });
+        
+        return future;
+    }
+    
+private:
+
+    template <
+        typename RetType, 
+        typename Fn>
+    struct Continuation
+    {
+        Future mReady;
+        Promise<RetType> mPromise;
+        Fn mFn;
+        
+        void operator()()
+        {
+            // get() rethrows the failure of the antecedent, which set_from forwards
+            auto invoke = [this]() -> RetType
+            {
+                if constexpr (is_void_v<T>)
+                {
+                    mReady.get();
+                    return mFn();
+                }
+                else
+                {
+                    return mFn(mReady.get());
+                }
+            };
+            
+            mPromise.set_from(invoke);
+        }
+        
+        // the executor would not take the continuation (a full bounded queue, say)
+        void abandon(exception_ptr e)
+        {
+            mPromise.set_exception(std::move(e));
+        }
+    };
+};
+
+template <
+    typename T>
+class Promise
+{
+    SharedState<T>* mState{SharedState<T>::create()};
+    
+public:
+
+    Promise() = default;
+    
+    // move enabled
+    Promise(Promise&& rhs) noexcept : mState(exchange(rhs.mState, nullptr)) {}
+    
+    // copy disabled
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+    Promise& operator=(Promise&&) = delete;
+    
+    // a promise that goes away unfulfilled breaks it, just like std::promise
+    ~Promise() noexcept
+    {
+        if (mState)
+        {
+            if (!mState->mReady.load(memory_order_relaxed))
+            {
+                set_exception(make_exception_ptr(future_error(future_errc::broken_promise)));
+            }
+            
+            mState->release();
+        }
+    }
+    
+    // may only be called once, before the promise is fulfilled
+    Future<T> get_future()
+    {
+        return Future<T>(mState);
+    }
+    
+    // where continuations attached to the future get scheduled
+    void set_executor(Executor executor)
+    {
+        mState->mExecutor = executor;
+    }
+    
+    template <
+        typename... V>
+    void set_value(V&&... v)
+    {
+        ::new (static_cast<void*>(mState->mValue)) typename SharedState<T>::ValueType(std::forward<V>(v)...);
+        mState->mHasValue = true;
+        mState->make_ready();
+    }
+    
+    void set_exception(exception_ptr e)
+    {
+        mState->mException = std::move(e);
+        mState->make_ready();
+    }
+    
+    // fulfil the promise with the outcome of invoking *f*
+    template <
+        typename F>
+    void set_from(F& f)
+    {
+        try
+        {
+            if constexpr (is_void_v<T>)
+            {
+                f();
+                set_value();
+            }
+            else
+            {
+                set_value(f());
+            }
+        }
+        catch (...)
+        {
+            set_exception(current_exception());
+        }
+    }
+};
+
+// a future that becomes ready once all of *futures* are
+// it carries their results in order, or the first failure (in order) if any of them failed
+// no thread waits in the meantime: the last future to complete fulfils the combined one
+template <
+    typename T>
+auto when_all(vector<Future<T>> futures)
+{
+    using RetType = conditional_t<is_void_v<T>, void, vector<T>>;
+    using Slot = conditional_t<is_void_v<T>, char, optional<T>>;
+    
+    struct State
+    {
+        atomic<size_t> mRemaining;
+        vector<Slot> mResults;
+        vector<exception_ptr> mErrors;
+        Promise<RetType> mPromise;
+        
+        explicit State(size_t n) : mRemaining(n), mResults(n), mErrors(n) {}
+        
+        void finish()
+        {
+            for (auto& e : mErrors)
+            {
+                if (e)
+                {
+                    mPromise.set_exception(e);
+                    return;
+                }
+            }
+            
+            if constexpr (is_void_v<T>)
+            {
+                mPromise.set_value();
+            }
+            else
+            {
+                vector<T> results;
+                results.reserve(mResults.size());
+                
+                for (auto& r : mResults)
+                {
+                    results.push_back(std::move(*r));
+                }
+                
+                mPromise.set_value(std::move(results));
+            }
+        }
+    };
+    
+    auto state = make_shared<State>(futures.size());
+    
+    if (!futures.empty())
+    {
+        state->mPromise.set_executor(futures.front().executor());
+    }
+    
+    Future<RetType> result = state->mPromise.get_future();
+    
+    if (futures.empty())
+    {
+        state->finish();
+        return result;
+    }
+    
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        futures[i].on_ready([state, i](Future<T> ready)
+        {
+            try
+            {
+                if constexpr (is_void_v<T>)
+                {
+                    ready.get();
+                }
+                else
+                {
+                    state->mResults[i].emplace(ready.get());
+                }
+            }
+            catch (...)
+            {
+                state->mErrors[i] = current_exception();
+            }
+            
+            // the acq_rel makes every other slot's write visible to whoever finishes
+            if (state->mRemaining.fetch_sub(1, memory_order_acq_rel) == 1)
+            {
+                state->finish();
+            }
+        });
+    }
+    
+    return result;
+}
+
+// a future that becomes ready as soon as the first of *futures* is, with its index (and result)
+// a failure counts as completion: the combined future fails the same way
+// the remaining futures run to completion, their results are dropped
+template <
+    typename T>
+auto when_any(vector<Future<T>> futures)
+{
+    using RetType = conditional_t<is_void_v<T>, size_t, pair<size_t, T>>;
+    
+    struct State
+    {
+        atomic<bool> mDone{false};
+        Promise<RetType> mPromise;
+    };
+    
+    if (futures.empty())
+    {
+        throw invalid_argument("when_any of no futures");
+    }
+    
+    auto state = make_shared<State>();
+    state->mPromise.set_executor(futures.front().executor());
+    Future<RetType> result = state->mPromise.get_future();
+    
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        futures[i].on_ready([state, i](Future<T> ready)
+        {
+            if (state->mDone.exchange(true, memory_order_acq_rel))
+            {
+                return;
+            }
+            
+            try
+            {
+                if constexpr (is_void_v<T>)
+                {
+                    ready.get();
+                    state->mPromise.set_value(i);
+                }
+                else
+                {
+                    state->mPromise.set_value(i, ready.get());
+                }
+            }
+            catch (...)
+            {
+                state->mPromise.set_exception(current_exception());
+            }
+        });
+    }
+    
+    return result;
+}
+
+#ifdef __cpp_impl_coroutine
+template <typename>
+class ThreadPool;
+
+// a lazily started coroutine that produces a T (not to be confused with Task, the pool's unit of work)
+// co_await it from another coroutine, which it resumes once done, or hand it over to ThreadPool::spawn()
+// the result travels through a recycled Promise/Future state, so the coroutine frame is the only allocation
+template <
+    typename T>
+class task
+{
+    template <typename>
+    friend class ThreadPool;
+    
+    // hand over to the awaiting coroutine (symmetric transfer, so that chains of tasks don't grow the stack)
+    // a detached (spawned) task has nobody to hand over to, and cleans up after itself
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+        
+        template <typename P>
+        coroutine_handle<> await_suspend(coroutine_handle<P> h) noexcept
+        {
+            auto& p = h.promise();
+            
+            if (p.mContinuation)
+            {
+                return p.mContinuation;
+            }
+            
+            if (p.mDetached)
+            {
+                h.destroy();
+            }
+            
+            return noop_coroutine();
+        }
+        
+        void await_resume() noexcept
+        {}
+    };
+    
+    struct PromiseBase
+    {
+        Promise<T> mPromise{};
+        coroutine_handle<> mContinuation{};
+        bool mDetached{false};
+        
+        suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+        
+        auto final_suspend() noexcept
+        {
+            return FinalAwaiter{};
+        }
+        
+        void unhandled_exception()
+        {
+            mPromise.set_exception(current_exception());
+        }
+    };
+    
+    struct ValuePromise : PromiseBase
+    {
+        template <typename V>
+        void return_value(V&& v)
+        {
+            this->mPromise.set_value(std::forward<V>(v));
+        }
+    };
+    
+    struct VoidPromise : PromiseBase
+    {
+        void return_void()
+        {
+            this->mPromise.set_value();
+        }
+    };
+    
+public:
+
+    struct promise_type : conditional_t<is_void_v<T>, VoidPromise, ValuePromise>
+    {
+        task get_return_object()
+        {
+            return task(coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+    
+private:
+
+    coroutine_handle<promise_type> mHandle{};
+    Future<T> mFuture{};
+    
+    explicit task(coroutine_handle<promise_type> h) : mHandle(h), mFuture(h.promise().mPromise.get_future()) {}
+    
+public:
+
+    task() = default;
+    
+    // move enabled
+    task(task&& rhs) noexcept : mHandle(exchange(rhs.mHandle, nullptr)), mFuture(std::move(rhs.mFuture)) {}
+    
+    task& operator=(task&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (mHandle)
+            {
+                mHandle.destroy();
+            }
+            
+            mHandle = exchange(rhs.mHandle, nullptr);
+            mFuture = std::move(rhs.mFuture);
+        }
+        
+        return *this;
+    }
+    
+    // copy disabled
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    
+    // a task that never got to run breaks its promise
+    ~task()
+    {
+        if (mHandle)
+        {
+            mHandle.destroy();
+        }
+    }
+    
+    // starts the task on the awaiting thread, and resumes the awaiting coroutine once the task is done
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter
+        {
+            task& mTask;
+            
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+            
+            coroutine_handle<> await_suspend(coroutine_handle<> h) noexcept
+            {
+                mTask.mHandle.promise().mContinuation = h;
+                return mTask.mHandle;
+            }
+            
+            T await_resume()
+            {
+                return mTask.mFuture.get();
+            }
+        };
+        
+        return Awaiter{*this};
+    }
+};
+#endif
+
+// a growable circular buffer
+// unlike std::deque, which keeps allocating and freeing its blocks as elements flow through it,
+// the storage only ever grows, so a queue in steady state does no allocations
+template <
+    typename T>
+class RingDeque
+{
+    vector<T> mSlots = vector<T>(16);
+    size_t mHead{0};
+    size_t mSize{0};
+    
+    size_t slot(size_t i) const
+    {
+        return (mHead + i) & (mSlots.size() - 1);
+    }
+    
+    void grow()
+    {
+        vector<T> slots(mSlots.size() * 2);
+        
+        for (size_t i = 0; i < mSize; ++i)
+        {
+            slots[i] = std::move(mSlots[slot(i)]);
+        }
+        
+        mSlots.swap(slots);
+        mHead = 0;
+    }
+    
+public:
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+    
+    size_t size() const
+    {
+        return mSize;
+    }
+    
+    void push_back(T t)
+    {
+        if (mSize == mSlots.size())
+        {
+            grow();
+        }
+        
+        mSlots[slot(mSize)] = std::move(t);
+        ++mSize;
+    }
+    
+    T pop_back()
+    {
+        --mSize;
+        return std::move(mSlots[slot(mSize)]);
+    }
+    
+    T pop_front()
+    {
+        T t = std::move(mSlots[mHead]);
+        mHead = slot(1);
+        --mSize;
+        return t;
+    }
+    
+    void clear()
+    {
+        while (!empty())
+        {
+            pop_back();
+        }
+    }
+};
+
+// the priority of a task, for the pools with a priority discipline (ignored by the others)
+// the bigger the value, the higher the priority
+struct priority
+{
+    int value{0};
+};
+
+// the coarse priorities that the deadline_lanes discipline serves strictly in order
+// (as priorities, they mean the same to the other priority disciplines)
+enum class lane
+{
+    low = -1,
+    normal = 0,
+    high = 1
+};
+
+// everything a discipline may want to know about a task to order it
+// a task without a deadline has the farthest deadline possible
+struct urgency
+{
+    using clock = chrono::steady_clock;
+    
+    int priority{0};
+    clock::time_point deadline{clock::time_point::max()};
+    
+    urgency() = default;
+    
+    urgency(struct priority p) : priority(p.value) {}
+    
+    urgency(lane l, clock::time_point d = clock::time_point::max()) : priority(static_cast<int>(l)), deadline(d) {}
+    
+    template <
+        typename Rep,
+        typename Period>
+    urgency(lane l, chrono::duration<Rep, Period> timeout) : urgency(l, clock::now() + timeout) {}
+    
+    bool has_deadline() const
+    {
+        return deadline != clock::time_point::max();
+    }
+};
+
+// the queue disciplines for the pool's shared queue, one of which is picked at compile time via the pool's template parameter
+// a discipline is a self synchronized queue of tasks providing:
+//   void   push(Task task, const urgency& u)
+//   void   push_batch(It first, It last, MakeTask& makeTask, const urgency& u)   (pushes makeTask(*it) for every element, under one lock)
+//   bool   try_pop(Task& task)
+//   size_t clear(RingDeque<Task>& dropped)     (moves every waiting task into *dropped*, returns how many)
+//   static constexpr bool bounded = false
+//
+// or, for a bounded discipline (one that may turn a task down when full):
+//   bool   try_push(Task& task, const urgency& u)  (moves from *task* only on success)
+//   bool   try_pop(Task& task)
+//   size_t clear(RingDeque<Task>& dropped)
+//   static constexpr bool bounded = true
+//   static constexpr backpressure policy       (what the pool does when the queue is full)
+//   static constexpr size_t capacity           (also the most tasks a worker's own deque holds in work_stealing mode)
+
+// first in, first out
+// tasks start in the order they were submitted, so no task starves under sustained load
+class fifo
+{
+    mutex mMutex{};
+    RingDeque<Task> mTasks{};
+    
+public:
+
+    static constexpr bool bounded = false;
+    
+    void push(Task task, const urgency& /*u*/)
+    {
+        unique_lock<mutex> lk(mMutex);
+        mTasks.push_back(move(task));
+    }
+    
+    template <
+        typename It,
+        typename MakeTask>
+    void push_batch(It first, It last, MakeTask& makeTask, const urgency& /*u*/)
+    {
+        unique_lock<mutex> lk(mMutex);
+        for (; first != last; ++first)
+        {
+            mTasks.push_back(makeTask(*first));
+        }
+    }
+    
+    bool try_pop(Task& task)
+    {
+        unique_lock<mutex> lk(mMutex);
+        if (mTasks.empty())
+        {
+            return false;
+        }
+        
+        task = mTasks.pop_front();
+        return true;
+    }
+    
+    size_t clear(RingDeque<Task>& dropped)
+    {
+        unique_lock<mutex> lk(mMutex);
+        size_t numTasks = mTasks.size();
+        while (!mTasks.empty())
+        {
+            dropped.push_back(mTasks.pop_front());
+        }
+        return numTasks;
+    }
+};
+
+// last in, first out
+// the most recently submitted task (whose data is most likely still in cache) starts first
+// old tasks may starve under sustained load
+class lifo
+{
+    mutex mMutex{};
+    RingDeque<Task> mTasks{};
+    
+public:
+
+    static constexpr bool bounded = false;
+    
+    void push(Task task, const urgency& /*u*/)
+    {
+        unique_lock<mutex> lk(mMutex);
+        mTasks.push_back(move(task));
+    }
+    
+    template <
+        typename It,
+        typename MakeTask>
+    void push_batch(It first, It last, MakeTask& makeTask, const urgency& /*u*/)
+    {
+        unique_lock<mutex> lk(mMutex);
+        for (; first != last; ++first)
+        {
+            mTasks.push_back(makeTask(*first));
+        }
+    }
+    
+    bool try_pop(Task& task)
+    {
+        unique_lock<mutex> lk(mMutex);
+        if (mTasks.empty())
+        {
+            return false;
+        }
+        
+        task = mTasks.pop_back();
+        return true;
+    }
+    
+    size_t clear(RingDeque<Task>& dropped)
+    {
+        unique_lock<mutex> lk(mMutex);
+        size_t numTasks = mTasks.size();
+        while (!mTasks.empty())
+        {
+            dropped.push_back(mTasks.pop_front());
+        }
+        return numTasks;
+    }
+};
+
+// highest priority first, with aging
+// a waiting task gains one priority level for every *AgingInterval* tasks submitted after it, so even the lowest priority
+// task eventually overtakes a stream of higher priority ones
+// since every task ages at the same rate, that boils down to ordering by (submission ticket - priority * AgingInterval),
+// a key fixed at submission time: a plain binary heap does, with no periodic re-prioritization
+template <
+    size_t AgingInterval = 64>
+class priority_aging
+{
+    struct Entry
+    {
+        long long mKey{};
+        Task mTask{};
+    };
+    
+    // a min heap on the key
+    static bool later(const Entry& lhs, const Entry& rhs)
+    {
+        return lhs.mKey > rhs.mKey;
+    }
+    
+    mutex mMutex{};
+    vector<Entry> mHeap{};
+    long long mTicket{0};
+    
+public:
+
+    static constexpr bool bounded = false;
+    
+    void push(Task task, const urgency& u)
+    {
+        unique_lock<mutex> lk(mMutex);
+        mHeap.push_back(Entry{mTicket++ - static_cast<long long>(u.priority) * static_cast<long long>(AgingInterval), move(task)});
+        push_heap(mHeap.begin(), mHeap.end(), later);
+    }
+    
+    template <
+        typename It,
+        typename MakeTask>
+    void push_batch(It first, It last, MakeTask& makeTask, const urgency& u)
+    {
+        unique_lock<mutex> lk(mMutex);
+        for (; first != last; ++first)
+        {
+            mHeap.push_back(Entry{mTicket++ - static_cast<long long>(u.priority) * static_cast<long long>(AgingInterval), makeTask(*first)});
+            push_heap(mHeap.begin(), mHeap.end(), later);
+        }
+    }
+    
+    bool try_pop(Task& task)
+    {
+        unique_lock<mutex> lk(mMutex);
+        if (mHeap.empty())
+        {
+            return false;
+        }
+        
+        pop_heap(mHeap.begin(), mHeap.end(), later);
+        task = move(mHeap.back().mTask);
+        mHeap.pop_back();
+        return true;
+    }
+    
+    size_t clear(RingDeque<Task>& dropped)
+    {
+        unique_lock<mutex> lk(mMutex);
+        size_t numTasks = mHeap.size();
+        for (Entry& entry : mHeap)
+        {
+            dropped.push_back(move(entry.mTask));
+        }
+        mHeap.clear();
+        return numTasks;
+    }
+};
+
+// strict priority lanes (high, normal, low), each served earliest deadline first
+// a worker only ever picks a normal task if no high one is waiting, and a low one if neither is; since a running task is
+// never preempted, a foreground task waits for at most the one background task quantum already under way on each worker
+// tasks without a deadline go after the ones with a deadline in their lane, in submission order
+// a task that starts after its deadline has passed counts as a deadline miss
+class deadline_lanes
+{
+    struct Entry
+    {
+        urgency::clock::time_point mDeadline{};
+        unsigned long long mTicket{};
+        Task mTask{};
+    };
+    
+    // a min heap on (deadline, ticket)
+    static bool later(const Entry& lhs, const Entry& rhs)
+    {
+        return lhs.mDeadline != rhs.mDeadline ? lhs.mDeadline > rhs.mDeadline : lhs.mTicket > rhs.mTicket;
+    }
+    
+    static constexpr size_t NumLanes = 3;
+    
+    mutex mMutex{};
+    
+    // indexed by high, normal, low
+    vector<Entry> mLanes[NumLanes]{};
+    unsigned long long mTicket{0};
+    
+    atomic<size_t> mDeadlineMisses{0};
+    
+    static size_t lane_of(const urgency& u)
+    {
+        return u.priority > 0 ? 0 : (u.priority == 0 ? 1 : 2);
+    }
+    
+    void push_locked(Task task, const urgency& u)
+    {
+        vector<Entry>& heap = mLanes[lane_of(u)];
+        heap.push_back(Entry{u.deadline, mTicket++, move(task)});
+        push_heap(heap.begin(), heap.end(), later);
+    }
+    
+public:
+
+    static constexpr bool bounded = false;
+    
+    void push(Task task, const urgency& u)
+    {
+        unique_lock<mutex> lk(mMutex);
+        push_locked(move(task), u);
+    }
+    
+    template <
+        typename It,
+        typename MakeTask>
+    void push_batch(It first, It last, MakeTask& makeTask, const urgency& u)
+    {
+        unique_lock<mutex> lk(mMutex);
+        for (; first != last; ++first)
+        {
+            push_locked(makeTask(*first), u);
+        }
+    }
+    
+    bool try_pop(Task& task)
+    {
+        unique_lock<mutex> lk(mMutex);
+        
+        for (vector<Entry>& heap : mLanes)
+        {
+            if (!heap.empty())
+            {
+                pop_heap(heap.begin(), heap.end(), later);
+                
+                Entry& entry = heap.back();
+                if (entry.mDeadline != urgency::clock::time_point::max() && urgency::clock::now() > entry.mDeadline)
+                {
+                    mDeadlineMisses.fetch_add(1, memory_order_relaxed);
+                }
+                
+                task = move(entry.mTask);
+                heap.pop_back();
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    size_t clear(RingDeque<Task>& dropped)
+    {
+        unique_lock<mutex> lk(mMutex);
+        
+        size_t numTasks{0};
+        for (vector<Entry>& heap : mLanes)
+        {
+            numTasks += heap.size();
+            for (Entry& entry : heap)
+            {
+                dropped.push_back(move(entry.mTask));
+            }
+            heap.clear();
+        }
+        
+        return numTasks;
+    }
+    
+    // the number of tasks so far that started after their deadline
+    size_t deadline_misses() const
+    {
+        return mDeadlineMisses.load(memory_order_relaxed);
+    }
+};
+
+// what the pool does with a task submitted while its bounded queue is full
+// block       : the submitter waits until a worker makes room
+// spin        : the submitter busy waits until a worker makes room
+//               (with either of the above, a worker thread never waits: it runs the task itself instead)
+// reject      : the task gets abandoned with a queue_full error, which the future returned to the submitter carries
+// caller_runs : the submitter runs the task itself, which throttles it down to the pace of the pool
+enum class backpressure
+{
+    block,
+    spin,
+    reject,
+    caller_runs
+};
+
+class queue_full : public runtime_error
+{
+    
+public:
+
+    queue_full() : runtime_error("ThreadPool queue full") {}
+};
+
+// what a task that got cancelled before it could run fails its future with
+class task_cancelled : public runtime_error
+{
+    
+public:
+
+    task_cancelled() : runtime_error("ThreadPool task cancelled") {}
+};
+
+// cooperative cancellation
+// a cancellation_source hands out tokens; cancelling the source flags all of them (and the tokens of the sources linked
+// to it), which a running task polls wherever it is safe for it to stop. a task enqueued with a token that has been
+// cancelled by the time a worker gets to it does not start at all, and its future fails with task_cancelled
+// a source per task cancels that task, a source shared by many tasks cancels the whole group
+class cancellation_token
+{
+    friend class cancellation_source;
+    
+    struct State
+    {
+        atomic<bool> mCancelled{false};
+        
+        // a linked source is cancelled along with its parent
+        shared_ptr<const State> mParent{};
+    };
+    
+    shared_ptr<const State> mState{};
+    
+    explicit cancellation_token(shared_ptr<const State> state) : mState(move(state)) {}
+    
+public:
+
+    // a token that never gets cancelled
+    cancellation_token() = default;
+    
+    // one load per link in the chain of sources, just one for a source with no parent
+    bool is_cancelled() const
+    {
+        for (const State* state = mState.get(); state; state = state->mParent.get())
+        {
+            if (state->mCancelled.load(memory_order_acquire))
+            {
+                return true;
+            }
+        }
+        
+        return false;
+    }
+};
+
+class cancellation_source
+{
+    shared_ptr<cancellation_token::State> mState{make_shared<cancellation_token::State>()};
+    
+public:
+
+    cancellation_source() = default;
+    
+    // a source that is cancelled along with *parent* (say, one for a single task within a group)
+    explicit cancellation_source(const cancellation_token& parent)
+    {
+        mState->mParent = parent.mState;
+    }
+    
+    cancellation_token token() const
+    {
+        return cancellation_token(mState);
+    }
+    
+    void cancel()
+    {
+        mState->mCancelled.store(true, memory_order_release);
+    }
+    
+    bool is_cancelled() const
+    {
+        return token().is_cancelled();
+    }
+};
+
+// what a running task polls to learn whether it should stop: either the token it was enqueued with got cancelled,
+// or its pool is shutting down with shutdown_now()
+namespace this_task
+{
+    inline thread_local const cancellation_token* tlsToken{nullptr};
+    inline thread_local const atomic<bool>* tlsAbort{nullptr};
+    
+    inline bool cancellation_requested()
+    {
+        return (tlsAbort && tlsAbort->load(memory_order_relaxed)) || (tlsToken && tlsToken->is_cancelled());
+    }
+}
+
+// a lock-free, bounded, multi producer multi consumer queue (after Dmitry Vyukov)
+// first in, first out, and, unlike the other disciplines, fixed in size: a burst of submissions cannot exhaust the memory
+//
+// each cell carries a sequence number that tells whose turn it is:
+// cell.seq == pos           : free, for the producer that claims enqueue position *pos*
+// cell.seq == pos + 1       : full, for the consumer that claims dequeue position *pos*
+// a position is claimed with a CAS on the enqueue (dequeue) counter, after which the cell is exclusively ours until we
+// publish it by bumping its sequence number; producers and consumers only ever contend on their own counter
+template <
+    size_t Capacity = 1024,
+    backpressure Policy = backpressure::block>
+class bounded_mpmc
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "the capacity must be a power of two");
+    
+    static constexpr size_t CacheLineSize = 64;
+    
+    struct Cell
+    {
+        atomic<size_t> mSequence{};
+        Task mTask{};
+    };
+    
+    // the cells are allocated once, up front
+    unique_ptr<Cell[]> mCells{make_unique<Cell[]>(Capacity)};
+    
+    // the counters sit on cache lines of their own, so that producers and consumers do not false share
+    alignas(CacheLineSize) atomic<size_t> mEnqueuePos{0};
+    alignas(CacheLineSize) atomic<size_t> mDequeuePos{0};
+    alignas(CacheLineSize) char mPadding[CacheLineSize]{};
+    
+public:
+
+    static constexpr bool bounded = true;
+    static constexpr backpressure policy = Policy;
+    static constexpr size_t capacity = Capacity;
+    
+    bounded_mpmc()
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+        {
+            mCells[i].mSequence.store(i, memory_order_relaxed);
+        }
+    }
+    
+    bool try_push(Task& task, const urgency& /*u*/)
+    {
+        size_t pos = mEnqueuePos.load(memory_order_relaxed);
+        
+        while (true)
+        {
+            Cell& cell = mCells[pos & (Capacity - 1)];
+            size_t seq = cell.mSequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            
+            if (diff == 0)
+            {
+                // the cell is free; try to claim it
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    cell.mTask = move(task);
+                    cell.mSequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // the cell still holds the task pushed a lap ago: we are full
+                return false;
+            }
+            else
+            {
+                // another producer got here first
+                pos = mEnqueuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+    
+    bool try_pop(Task& task)
+    {
+        size_t pos = mDequeuePos.load(memory_order_relaxed);
+        
+        while (true)
+        {
+            Cell& cell = mCells[pos & (Capacity - 1)];
+            size_t seq = cell.mSequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            
+            if (diff == 0)
+            {
+                // the cell is full; try to claim it
+                if (mDequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    task = move(cell.mTask);
+                    cell.mSequence.store(pos + Capacity, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // nothing pushed here yet: we are empty
+                return false;
+            }
+            else
+            {
+                // another consumer got here first
+                pos = mDequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+    
+    size_t clear(RingDeque<Task>& dropped)
+    {
+        size_t numTasks{0};
+        
+        Task task{};
+        while (try_pop(task))
+        {
+            dropped.push_back(move(task));
+            ++numTasks;
+        }
+        
+        return numTasks;
+    }
+};
+
+// tell the CPU that we are busy waiting (eases the pressure on the sibling hyperthread and on the memory bus)
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    this_thread::yield();
+#endif
+}
+
+// how tasks submitted from within the pool's own worker threads are scheduled
+// shared_queue  : every task goes to the one global queue
+// work_stealing : a task submitted by a worker goes to that worker's own deque
+//                 the owner pushes/pops at the back (hot caches, no contention with other owners)
+//                 idle workers steal from the front of other workers' deques (the oldest, typically biggest, pieces of work)
+//                 external submitters still go through the global (injection) queue
+enum class scheduling
+{
+    shared_queue,
+    work_stealing
+};
+
+// the cpus of the machine grouped by NUMA node, as far as this process is allowed to run on them
+// read from /sys/devices/system/node (Linux); elsewhere, or if that is unavailable, a single node with all the cpus
+class cpu_topology
+{
+    vector<vector<int>> mNodes{};
+    
+    // the OS's id of each of the above (which need not be dense: memory only nodes, say, are left out)
+    vector<int> mNodeIds{};
+    
+    // parse a cpu (or node) list, like "0-3,8,10-11"
+    static vector<int> parse_list(const string& list)
+    {
+        vector<int> ids{};
+        
+        stringstream ss(list);
+        string range{};
+        while (getline(ss, range, ','))
+        {
+            if (range.empty() || range == "\n")
+            {
+                continue;
+            }
+            
+            size_t dash = range.find('-');
+            int first = stoi(range.substr(0, dash));
+            int last = (dash == string::npos) ? first : stoi(range.substr(dash + 1));
+            
+            for (int id = first; id <= last; ++id)
+            {
+                ids.push_back(id);
+            }
+        }
+        
+        return ids;
+    }
+    
+    static string read_line(const string& path)
+    {
+        ifstream in(path);
+        string line{};
+        getline(in, line);
+        return line;
+    }
+    
+    static bool allowed(int cpu)
+    {
+#ifdef __linux__
+        static const cpu_set_t allowedSet = []()
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (sched_getaffinity(0, sizeof(set), &set) != 0)
+            {
+                for (int i = 0; i < CPU_SETSIZE; ++i)
+                {
+                    CPU_SET(i, &set);
+                }
+            }
+            
+            return set;
+        }();
+        
+        return cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowedSet);
+#else
+        return true;
+#endif
+    }
+    
+public:
+
+    static cpu_topology detect()
+    {
+        cpu_topology topology{};
+        
+        for (int node : parse_list(read_line("/sys/devices/system/node/online")))
+        {
+            vector<int> cpus{};
+            for (int cpu : parse_list(read_line("/sys/devices/system/node/node" + to_string(node) + "/cpulist")))
+            {
+                if (allowed(cpu))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+            
+            // memory only nodes (and nodes we may not run on) have no use for workers
+            if (!cpus.empty())
+            {
+                topology.mNodes.push_back(move(cpus));
+                topology.mNodeIds.push_back(node);
+            }
+        }
+        
+        if (topology.mNodes.empty())
+        {
+            vector<int> cpus{};
+            for (int cpu = 0; cpu < static_cast<int>(max(1u, thread::hardware_concurrency())); ++cpu)
+            {
+                if (allowed(cpu))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+            
+            topology.mNodes.push_back(move(cpus));
+            topology.mNodeIds.push_back(0);
+        }
+        
+        return topology;
+    }
+    
+    size_t num_nodes() const
+    {
+        return mNodes.size();
+    }
+    
+    const vector<int>& cpus(size_t node) const
+    {
+        return mNodes[node];
+    }
+    
+    int node_id(size_t node) const
+    {
+        return mNodeIds[node];
+    }
+    
+    vector<int> all_cpus() const
+    {
+        vector<int> cpus{};
+        for (const auto& node : mNodes)
+        {
+            cpus.insert(cpus.end(), node.begin(), node.end());
+        }
+        
+        return cpus;
+    }
+};
+
+// pin the calling thread to the given cpus (a no-op where that is not supported)
+inline bool pin_current_thread(const vector<int>& cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        CPU_SET(cpu, &set);
+    }
+    
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// a hint on which NUMA node a task would best run on: typically, the one whose memory holds the task's data
+// (*node* is the OS's node id, as in /sys/devices/system/node/node<id>)
+struct locality
+{
+    int node{-1};
+    
+    // the node whose memory backs the page holding *address* (no hint, if that cannot be found out)
+    static locality of(const void* address)
+    {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+        // MPOL_F_NODE | MPOL_F_ADDR, from <numaif.h>, sans libnuma
+        constexpr unsigned long NodeOfAddress = 1 | 2;
+        
+        int node = -1;
+        if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, NodeOfAddress) == 0)
+        {
+            return locality{node};
+        }
+#else
+        (void)address;
+#endif
+        return locality{};
+    }
+};
+
+// identifies an armed timer, to cancel it by
+// a handle outlives its timer harmlessly: once the timer has fired (or got cancelled), the handle is recognised as stale
+class timer_id
+{
+    friend class TimerWheel;
+    
+    void* mNode{nullptr};
+    uint64_t mGeneration{0};
+    
+    timer_id(void* node, uint64_t generation) : mNode(node), mGeneration(generation) {}
+    
+public:
+
+    timer_id() = default;
+};
+
+// a future for a task that runs once its timer fires, along with the handle to cancel the timer by
+template <
+    typename T>
+class TimedFuture : public Future<T>
+{
+    timer_id mTimer{};
+    
+public:
+
+    TimedFuture(Future<T>&& future, timer_id timer) : Future<T>(std::move(future)), mTimer(timer) {}
+    
+    timer_id timer() const
+    {
+        return mTimer;
+    }
+};
+
+// a hierarchical timing wheel (after Varghese and Lauck), serviced by a single thread
+// that hands the tasks of the expired timers over to an executor
+//
+// time advances in ticks. level 0 has a slot per tick for the next NumSlots ticks, level 1 a slot per NumSlots ticks
+// for the next NumSlots^2 ticks, and so on. a timer sits in the slot of the finest level that covers its deadline;
+// whenever the ticks cross a slot boundary of a coarser level, the timers of that slot get redistributed over the
+// finer levels (cascaded). each slot is an intrusive doubly linked list, so arming and cancelling a timer are O(1)
+// (no matter how many are armed), and a timer gets touched at most NumLevels times before it fires
+//
+// timers are recycled through a free list, so that a steady stream of timeouts does not allocate
+class TimerWheel
+{
+    static constexpr unsigned SlotBits = 6;
+    static constexpr uint64_t NumSlots = uint64_t(1) << SlotBits;
+    static constexpr uint64_t SlotMask = NumSlots - 1;
+    static constexpr unsigned NumLevels = 4;
+    
+    // timers further out than that are parked in the coarsest level, and come closer with every cascade
+    static constexpr uint64_t Horizon = uint64_t(1) << (SlotBits * NumLevels);
+    
+    static constexpr size_t ChunkSize = 256;
+    
+    enum class State
+    {
+        free,
+        armed,
+        firing,     // a periodic timer whose task is running; re-armed once it is done
+        cancelled   // ... and that got cancelled meanwhile
+    };
+    
+    struct Link
+    {
+        Link* mPrev{this};
+        Link* mNext{this};
+    };
+    
+    struct Node : Link
+    {
+        uint64_t mDeadline{0};
+        uint64_t mPeriod{0}; // in ticks, 0 for a one shot timer
+        uint64_t mGeneration{0};
+        State mState{State::free};
+        Task mTask{};
+    };
+    
+    // runs a periodic timer's task on a worker, and re-arms the timer once it is done (so that runs never overlap)
+    struct Fire
+    {
+        TimerWheel* mWheel;
+        Node* mNode;
+        
+        void operator()()
+        {
+            bool again = true;
+            
+            try
+            {
+                mNode->mTask();
+            }
+            catch (...)
+            {
+                // nobody to report it to: a periodic task that throws stops being scheduled
+                again = false;
+            }
+            
+            mWheel->rearm(mNode, again);
+        }
+        
+        // this round got turned down, the next ones may still make it
+        void abandon(exception_ptr)
+        {
+            mWheel->rearm(mNode, true);
+        }
+    };
+    
+    Executor mExecutor{};
+    chrono::nanoseconds mTick{};
+    chrono::steady_clock::time_point mStart{chrono::steady_clock::now()};
+    
+    mutex mMutex{};
+    condition_variable mConditionVariable{};
+    thread mThread{};
+    bool mStop{false};
+    
+    // all of the below is guarded by mMutex
+    Link mSlots[NumLevels][NumSlots]{};
+    
+    // the last tick processed, and the number of timers in the slots
+    uint64_t mNow{0};
+    size_t mArmed{0};
+    
+    // the tick the timer thread sleeps until, so that arming a later timer need not wake it
+    uint64_t mWakeTick{UINT64_MAX};
+    
+    vector<unique_ptr<Node[]>> mChunks{};
+    Node* mFree{nullptr};
+    
+    // the tasks of the timers expired in a round, handed over once the lock is released (timer thread only)
+    vector<Task> mExpired{};
+    
+    static void link(Link& slot, Node* node)
+    {
+        node->mPrev = slot.mPrev;
+        node->mNext = &slot;
+        slot.mPrev->mNext = node;
+        slot.mPrev = node;
+    }
+    
+    static void unlink(Node* node)
+    {
+        node->mPrev->mNext = node->mNext;
+        node->mNext->mPrev = node->mPrev;
+        node->mPrev = node->mNext = node;
+    }
+    
+    uint64_t current_tick() const
+    {
+        return static_cast<uint64_t>((chrono::steady_clock::now() - mStart) / mTick);
+    }
+    
+    // the first tick at or after *when*, so that a timer never fires early
+    uint64_t tick_of(chrono::steady_clock::time_point when) const
+    {
+        if (when <= mStart)
+        {
+            return 0;
+        }
+        
+        auto elapsed = chrono::ceil<chrono::nanoseconds>(when - mStart);
+        return static_cast<uint64_t>((elapsed + mTick - chrono::nanoseconds(1)) / mTick);
+    }
+    
+    Node* allocate()
+    {
+        if (!mFree)
+        {
+            mChunks.emplace_back(make_unique<Node[]>(ChunkSize));
+            
+            Node* chunk = mChunks.back().get();
+            for (size_t i = 0; i < ChunkSize; ++i)
+            {
+                chunk[i].mNext = mFree;
+                mFree = &chunk[i];
+            }
+        }
+        
+        Node* node = mFree;
+        mFree = static_cast<Node*>(node->mNext);
+        node->mPrev = node->mNext = node;
+        
+        return node;
+    }
+    
+    // stales every handle to the node
+    void deallocate(Node* node)
+    {
+        ++node->mGeneration;
+        node->mState = State::free;
+        node->mNext = mFree;
+        mFree = node;
+    }
+    
+    // put the node in the slot that covers its deadline, as seen from mNow
+    void insert(Node* node)
+    {
+        uint64_t deadline = node->mDeadline;
+        if (deadline - mNow >= Horizon)
+        {
+            deadline = mNow + Horizon - 1;
+        }
+        
+        uint64_t delta = deadline - mNow;
+        
+        unsigned level = 0;
+        while (delta >= (uint64_t(1) << (SlotBits * (level + 1))))
+        {
+            ++level;
+        }
+        
+        link(mSlots[level][(deadline >> (SlotBits * level)) & SlotMask], node);
+        ++mArmed;
+    }
+    
+    // process the next tick: cascade the coarser slots whose time has come, then expire the current level 0 slot
+    void advance()
+    {
+        ++mNow;
+        
+        for (unsigned level = 1; level < NumLevels; ++level)
+        {
+            if ((mNow & ((uint64_t(1) << (SlotBits * level)) - 1)) != 0)
+            {
+                break;
+            }
+            
+            Link& slot = mSlots[level][(mNow >> (SlotBits * level)) & SlotMask];
+            while (slot.mNext != &slot)
+            {
+                Node* node = static_cast<Node*>(slot.mNext);
+                unlink(node);
+                --mArmed;
+                insert(node);
+            }
+        }
+        
+        Link& slot = mSlots[0][mNow & SlotMask];
+        while (slot.mNext != &slot)
+        {
+            Node* node = static_cast<Node*>(slot.mNext);
+            unlink(node);
+            --mArmed;
+            
+            if (node->mPeriod == 0)
+            {
+                mExpired.push_back(move(node->mTask));
+                deallocate(node);
+            }
+            else
+            {
+                node->mState = State::firing;
+                mExpired.push_back(Task(Fire{this, node}));
+            }
+        }
+    }
+    
+    // the next tick worth waking up for: one with timers in its level 0 slot, or one that cascades a coarser level
+    uint64_t next_event() const
+    {
+        uint64_t tick = mNow + 1;
+        while ((tick & SlotMask) != 0 && mSlots[0][tick & SlotMask].mNext == &mSlots[0][tick & SlotMask])
+        {
+            ++tick;
+        }
+        
+        return tick;
+    }
+    
+    void rearm(Node* node, bool again)
+    {
+        Task task;
+        
+        {
+            unique_lock<mutex> lk(mMutex);
+            
+            if (!again || mStop || node->mState == State::cancelled)
+            {
+                // destroyed outside of the lock, there is no telling what the callable's destructor does
+                task = move(node->mTask);
+                deallocate(node);
+                return;
+            }
+            
+            // at a fixed rate, skipping the beats that have been missed meanwhile
+            node->mState = State::armed;
+            node->mDeadline = max(node->mDeadline + node->mPeriod, mNow + 1);
+            insert(node);
+            
+            if (node->mDeadline >= mWakeTick)
+            {
+                return;
+            }
+        }
+        
+        mConditionVariable.notify_one();
+    }
+    
+    void run()
+    {
+        unique_lock<mutex> lk(mMutex);
+        
+        while (!mStop)
+        {
+            if (mArmed == 0)
+            {
+                mWakeTick = UINT64_MAX;
+                mConditionVariable.wait(lk, [this](){return mStop || mArmed > 0;});
+                continue;
+            }
+            
+            uint64_t now = current_tick();
+            while (mNow < now && mArmed > 0)
+            {
+                advance();
+            }
+            
+            if (!mExpired.empty())
+            {
+                lk.unlock();
+                
+                for (Task& task : mExpired)
+                {
+                    mExecutor.execute(move(task));
+                }
+                mExpired.clear();
+                
+                lk.lock();
+                continue;
+            }
+            
+            if (mArmed > 0)
+            {
+                mWakeTick = next_event();
+                mConditionVariable.wait_until(lk, mStart + mWakeTick * mTick);
+            }
+        }
+    }
+    
+public:
+
+    TimerWheel(Executor executor, chrono::nanoseconds tick)
+    : mExecutor(executor), mTick(max(tick, chrono::nanoseconds(1))) {}
+    
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    
+    ~TimerWheel()
+    {
+        stop();
+    }
+    
+    // hand *task* over to the executor at *when*, and then every *period* (if not zero) until cancelled
+    // the timer thread is started along with the first timer
+    timer_id arm(chrono::steady_clock::time_point when, chrono::nanoseconds period, Task task)
+    {
+        timer_id id{};
+        
+        {
+            unique_lock<mutex> lk(mMutex);
+            
+            if (!mStop)
+            {
+                // an empty wheel has nothing to catch up on
+                if (mArmed == 0)
+                {
+                    mNow = max(mNow, current_tick());
+                }
+                
+                Node* node = allocate();
+                node->mState = State::armed;
+                node->mDeadline = max(tick_of(when), mNow + 1);
+                node->mPeriod = period.count() > 0 ? max<uint64_t>(static_cast<uint64_t>(period / mTick), 1) : 0;
+                node->mTask = move(task);
+                insert(node);
+                
+                id = timer_id{node, node->mGeneration};
+                
+                if (!mThread.joinable())
+                {
+                    mThread = thread(&TimerWheel::run, this);
+                }
+                
+                if (node->mDeadline >= mWakeTick)
+                {
+                    return id;
+                }
+            }
+        }
+        
+        if (!id.mNode)
+        {
+            task.abandon(make_exception_ptr(task_cancelled()));
+            return id;
+        }
+        
+        mConditionVariable.notify_one();
+        return id;
+    }
+    
+    // returns whether the timer was still live: a one shot timer that has not fired yet gets its task abandoned
+    // (with task_cancelled), a periodic one runs no more (though a run under way completes)
+    bool cancel(timer_id id)
+    {
+        Node* node = static_cast<Node*>(id.mNode);
+        if (!node)
+        {
+            return false;
+        }
+        
+        Task task;
+        
+        {
+            unique_lock<mutex> lk(mMutex);
+            
+            if (node->mGeneration != id.mGeneration)
+            {
+                return false;
+            }
+            
+            if (node->mState == State::firing)
+            {
+                node->mState = State::cancelled;
+                return true;
+            }
+            
+            if (node->mState != State::armed)
+            {
+                return false;
+            }
+            
+            unlink(node);
+            --mArmed;
+            task = move(node->mTask);
+            deallocate(node);
+        }
+        
+        task.abandon(make_exception_ptr(task_cancelled()));
+        return true;
+    }
+    
+    // stop the timer thread and cancel every timer still armed
+    void stop()
+    {
+        {
+            unique_lock<mutex> lk(mMutex);
+            mStop = true;
+        }
+        
+        mConditionVariable.notify_one();
+        
+        if (mThread.joinable())
+        {
+            mThread.join();
+        }
+        
+        vector<Task> cancelled;
+        
+        {
+            unique_lock<mutex> lk(mMutex);
+            
+            for (auto& level : mSlots)
+            {
+                for (Link& slot : level)
+                {
+                    while (slot.mNext != &slot)
+                    {
+                        Node* node = static_cast<Node*>(slot.mNext);
+                        unlink(node);
+                        cancelled.push_back(move(node->mTask));
+                        deallocate(node);
+                    }
+                }
+            }
+            
+            mArmed = 0;
+        }
+        
+        for (Task& task : cancelled)
+        {
+            task.abandon(make_exception_ptr(task_cancelled()));
+        }
+    }
+};
+
+#ifdef THREAD_POOL_TELEMETRY
+// the cheapest timestamp there is: the cpu's time stamp counter (assumed invariant, as on any recent x86), which only
+// gets converted to nanoseconds when a snapshot is taken; the steady clock elsewhere
+struct cycle_clock
+{
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+};
+
+// a log-linear (HDR style) histogram of 64 bit values
+// a value is bucketed by its most significant bit and the SubBucketBits bits below it, so that every bucket is within
+// 1/2^SubBucketBits (about 6%) of the values in it, across the whole range, with no need to know that range up front
+// lock-free: the single writer records with a relaxed load and store (no read-modify-write), readers may come any time
+class AtomicHistogram
+{
+public:
+
+    static constexpr unsigned SubBucketBits = 4;
+    static constexpr uint64_t SubBuckets = uint64_t(1) << SubBucketBits;
+    static constexpr size_t NumBuckets = (64 - SubBucketBits + 1) * SubBuckets;
+    
+    static size_t index(uint64_t value)
+    {
+        // the small values get a bucket each
+        if (value < SubBuckets)
+        {
+            return static_cast<size_t>(value);
+        }
+        
+        unsigned shift = static_cast<unsigned>(63 - __builtin_clzll(value)) - SubBucketBits;
+        return (shift + 1) * SubBuckets + ((value >> shift) & (SubBuckets - 1));
+    }
+    
+    // the range of values [lower_bound(i), lower_bound(i) + width(i)) that bucket *i* holds
+    static uint64_t lower_bound(size_t i)
+    {
+        if (i < SubBuckets)
+        {
+            return i;
+        }
+        
+        return (SubBuckets + i % SubBuckets) << (i / SubBuckets - 1);
+    }
+    
+    static uint64_t width(size_t i)
+    {
+        return i < SubBuckets ? 1 : uint64_t(1) << (i / SubBuckets - 1);
+    }
+    
+    void record(uint64_t value)
+    {
+        atomic<uint64_t>& count = mCounts[index(value)];
+        count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    
+    // for a histogram with more than one writer
+    void record_shared(uint64_t value)
+    {
+        mCounts[index(value)].fetch_add(1, memory_order_relaxed);
+    }
+    
+    void add_to(vector<uint64_t>& counts) const
+    {
+        for (size_t i = 0; i < NumBuckets; ++i)
+        {
+            counts[i] += mCounts[i].load(memory_order_relaxed);
+        }
+    }
+    
+private:
+
+    atomic<uint64_t> mCounts[NumBuckets]{};
+};
+
+// a snapshot of (a merge of) AtomicHistograms, in nanoseconds
+class histogram
+{
+    vector<uint64_t> mCounts = vector<uint64_t>(AtomicHistogram::NumBuckets, 0);
+    double mNanosPerTick{1.0};
+    uint64_t mCount{0};
+    
+    // the middle of the bucket, which is within half a bucket width of every value in it
+    double value_at(size_t i) const
+    {
+        return (AtomicHistogram::lower_bound(i) + (AtomicHistogram::width(i) - 1) / 2.0) * mNanosPerTick;
+    }
+    
+public:
+
+    histogram() = default;
+    
+    histogram(vector<uint64_t> counts, double nanosPerTick)
+    : mCounts(move(counts)), mNanosPerTick(nanosPerTick), mCount(accumulate(mCounts.begin(), mCounts.end(), uint64_t(0))) {}
+    
+    uint64_t count() const
+    {
+        return mCount;
+    }
+    
+    // the value that a fraction *p* (0 to 1) of the samples do not exceed
+    double percentile(double p) const
+    {
+        if (mCount == 0)
+        {
+            return 0.0;
+        }
+        
+        uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(p * static_cast<double>(mCount) + 0.5), 1);
+        uint64_t seen{0};
+        
+        for (size_t i = 0; i < mCounts.size(); ++i)
+        {
+            seen += mCounts[i];
+            if (seen >= rank)
+            {
+                return value_at(i);
+            }
+        }
+        
+        return max();
+    }
+    
+    double mean() const
+    {
+        double sum{0.0};
+        for (size_t i = 0; i < mCounts.size(); ++i)
+        {
+            sum += value_at(i) * static_cast<double>(mCounts[i]);
+        }
+        
+        return mCount ? sum / static_cast<double>(mCount) : 0.0;
+    }
+    
+    double max() const
+    {
+        for (size_t i = mCounts.size(); i-- > 0;)
+        {
+            if (mCounts[i])
+            {
+                return value_at(i);
+            }
+        }
+        
+        return 0.0;
+    }
+};
+
+// what the pool records about the tasks it runs, and how its workers spend their time
+// a worker has one of its own (it is the only writer); the threads that help out (say, a waiting task_group) share one
+//
+// timing every task would take three time stamps per task, about as much as a small task takes to run; instead, one in
+// SampleEvery submissions (per submitting thread) gets a time stamp, and only those tasks get timed. that leaves the
+// percentiles as they are, at a fraction of the cost. the busy time is measured from the transitions between running
+// tasks and finding none, which take a time stamp each, but are rare under load
+class TaskTelemetry
+{
+    static void bump(atomic<uint64_t>& counter, uint64_t by, bool shared)
+    {
+        if (shared)
+        {
+            counter.fetch_add(by, memory_order_relaxed);
+        }
+        else
+        {
+            counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);
+        }
+    }
+    
+    // worker only: when the current busy or idle stretch started (0 when not in one)
+    uint64_t mBusySince{0};
+    uint64_t mIdleSince{0};
+    
+public:
+
+    static constexpr unsigned SampleEvery = 8;
+    
+    AtomicHistogram mQueueWait{};
+    AtomicHistogram mRunTime{};
+    
+    atomic<uint64_t> mTasks{0};
+    atomic<uint64_t> mSteals{0};
+    atomic<uint64_t> mParks{0};
+    
+    // cycle_clock ticks spent between finding work and running out of it
+    atomic<uint64_t> mBusy{0};
+    
+    // the time stamp for a task about to be queued: 0 (not to be timed), but for one in SampleEvery
+    static uint64_t stamp()
+    {
+        static thread_local unsigned tlsSubmissions{0};
+        return ++tlsSubmissions % SampleEvery == 0 ? cycle_clock::now() : 0;
+    }
+    
+    void run(Task& task, bool shared)
+    {
+        bump(mTasks, 1, shared);
+        
+        if (!task.queued_at())
+        {
+            task();
+            return;
+        }
+        
+        uint64_t start = cycle_clock::now();
+        task();
+        uint64_t end = cycle_clock::now();
+        
+        // the submitter may have read its clock on another cpu, a tad behind
+        uint64_t queueWait = start > task.queued_at() ? start - task.queued_at() : 0;
+        
+        if (shared)
+        {
+            mQueueWait.record_shared(queueWait);
+            mRunTime.record_shared(end - start);
+        }
+        else
+        {
+            mQueueWait.record(queueWait);
+            mRunTime.record(end - start);
+        }
+    }
+    
+    void found_work()
+    {
+        if (mIdleSince || !mBusySince)
+        {
+            mBusySince = cycle_clock::now();
+            mIdleSince = 0;
+        }
+    }
+    
+    void found_none()
+    {
+        if (!mIdleSince)
+        {
+            mIdleSince = cycle_clock::now();
+            
+            if (mBusySince)
+            {
+                bump(mBusy, mIdleSince - mBusySince, false);
+            }
+        }
+    }
+    
+    void stolen()
+    {
+        bump(mSteals, 1, false);
+    }
+    
+    void parked()
+    {
+        bump(mParks, 1, false);
+    }
+};
+
+// a snapshot of a pool's telemetry, cumulative since the pool started
+struct pool_stats
+{
+    // from submission to start, and from start to finish (of a sample of the tasks, see TaskTelemetry)
+    histogram queueWait{};
+    histogram runTime{};
+    
+    uint64_t tasks{0};
+    uint64_t steals{0};
+    uint64_t parks{0};
+    uint64_t wakes{0};
+    
+    chrono::nanoseconds elapsed{0};
+    chrono::nanoseconds busy{0};
+    int workers{0};
+    
+    // the fraction of the workers' time spent running tasks: busy / (elapsed * workers)
+    // (with respect to the current number of workers, should the pool be elastic)
+    double utilization{0.0};
+};
+
+// one "name value" pair per line, for a scraper to pick up
+inline ostream& operator<<(ostream& os, const pool_stats& stats)
+{
+    auto latencies = [&os](const char* name, const histogram& h)
+    {
+        os << name << "_count " << h.count() << '\n';
+        os << name << "_mean_ns " << h.mean() << '\n';
+        
+        for (auto [label, p] : {pair{"p50", 0.5}, pair{"p90", 0.9}, pair{"p99", 0.99}, pair{"p999", 0.999}})
+        {
+            os << name << '_' << label << "_ns " << h.percentile(p) << '\n';
+        }
+        
+        os << name << "_max_ns " << h.max() << '\n';
+    };
+    
+    latencies("queue_wait", stats.queueWait);
+    latencies("run_time", stats.runTime);
+    
+    os << "tasks " << stats.tasks << '\n'
+       << "steals " << stats.steals << '\n'
+       << "parks " << stats.parks << '\n'
+       << "wakes " << stats.wakes << '\n'
+       << "workers " << stats.workers << '\n'
+       << "utilization " << stats.utilization << '\n';
+    
+    return os;
+}
+#endif
+
+// how the pool places its workers
+struct pool_options
+{
+    int numThreads = static_cast<int>(thread::hardware_concurrency());
+    
+    scheduling mode = scheduling::shared_queue;
+    
+    // pin every worker to a single cpu, round robin over *cpus* (if given) or over all the cpus we may run on
+    bool pinWorkers = false;
+    vector<int> cpus{};
+    
+    // spread the workers evenly over the NUMA nodes, keep every one of them on its node's cpus, and give every node a
+    // shared queue of its own, so that a task submitted with a locality hint runs on the node where its data lives
+    bool numaAware = false;
+    
+    // elastic sizing, if maxThreads exceeds numThreads
+    // the pool starts with numThreads workers, adds one more (up to maxThreads) whenever the queueing latency exceeds
+    // latencyThreshold, and retires a worker that has been idle for idleTimeout (down to numThreads again)
+    int maxThreads = 0;
+    chrono::microseconds latencyThreshold{1000};
+    chrono::milliseconds idleTimeout{10000};
+    
+    // the resolution of the timers (enqueue_after, enqueue_at, enqueue_every)
+    chrono::nanoseconds timerTick = chrono::milliseconds(1);
+};
+
+template <typename>
+class task_group;
+
+template <
+    typename Discipline = fifo>
+class ThreadPool
+{
+    template <typename>
+    friend class task_group;
+    
+    // the per worker state
+    static constexpr size_t CacheLineSize = 64;
+    
+    // in the work stealing mode, each worker owns a deque of tasks
+    // the lock is only ever contended between the owner and a thief (never by external submitters)
+    struct Worker
+    {
+        mutex mMutex{};
+        RingDeque<Task> mTasks{};
+        thread mThread{};
+        
+        // the NUMA node the worker belongs to, and the cpus it runs on (empty: wherever the OS puts it)
+        size_t mNode{0};
+        vector<int> mCpus{};
+        
+        // whom to steal from, in order: the workers on the same node first, then the others
+        vector<size_t> mVictims{};
+        
+#ifdef THREAD_POOL_TELEMETRY
+        TaskTelemetry mTelemetry{};
+#endif
+        
+        // whether a thread currently runs in this slot (in an elastic pool, some slots may be vacant)
+        atomic<bool> mActive{false};
+        
+        // the number of tasks the worker has run, only ever written by the worker itself
+        atomic<unsigned long long> mTasksRun{0};
+        
+        // the worker's share of the pending count (see pending()), on a cache line of its own, since the others read it
+        alignas(CacheLineSize) atomic<long> mPending{0};
+    };
+    
+    // identifies the pool (and the worker therein) that the current thread belongs to, if any
+    static inline thread_local ThreadPool* tlsPool{nullptr};
+    static inline thread_local size_t tlsWorkerIndex{0};
+    
+    scheduling mScheduling{scheduling::shared_queue};
+    
+    // the shared (injection) queues, one per NUMA node (just one unless NUMA aware), ordered as per the discipline
+    vector<unique_ptr<Discipline>> mQueues{};
+    
+    // the OS's node id of each queue, to map locality hints to queues (empty unless NUMA aware)
+    vector<int> mNodeIds{};
+    
+    // spreads the submissions that come with no locality hint over the nodes
+    mutable atomic<size_t> mNextNode{0};
+    
+    // the mutex/condition variable on which idle workers sleep
+    mutex mMutex{};
+    condition_variable mConditionVariable{};
+    
+    // the mutex/condition variable on which submitters wait for room in a full bounded queue (backpressure::block)
+    mutex mRoomMutex{};
+    condition_variable mRoomConditionVariable{};
+    atomic<int> mBlockedSubmitters{0};
+    
+    vector<unique_ptr<Worker>> mWorkers{};
+    
+    // the number of tasks sitting in the injection queues and the worker deques is kept as a sum of counts, so that
+    // submitters and workers do not all bump the one cache line: a worker accounts for whatever it submits and fetches in
+    // its own count, any other thread in the count of the queue it deals with
+    // a single count may well be negative, and so may the sum, transiently, if a task gets fetched before its submitter
+    // has accounted for it
+    struct alignas(CacheLineSize) QueueCount
+    {
+        atomic<long> mValue{0};
+    };
+    unique_ptr<QueueCount[]> mQueuePending{};
+    
+    // work_stealing: roughly, the number of tasks ahead of the default urgency sitting in the injection queues
+    // while there are any, workers look there before their own deques, so that locally spawned work does not hold them up
+    atomic<long> mUrgentQueued{0};
+    
+    // the number of workers blocked (or about to block) on the condition variable
+    // a spinning worker does not count: it finds new work without being notified
+    atomic<int> mSleepers{0};
+    
+    atomic<bool> mDone{false};
+    
+    // set by shutdown_now(): queued tasks get dropped rather than run, running ones are asked to stop
+    atomic<bool> mAbort{false};
+    
+    // the number of worker threads that have not exited yet, so that a shutdown can wait for them with a timeout
+    // (std::thread::join() cannot)
+    mutex mExitMutex{};
+    condition_variable mExitConditionVariable{};
+    int mRunning{0};
+    
+    // elastic sizing
+    // a supervisor thread watches the queueing latency and adds workers; idle workers retire by themselves
+    bool mElastic{false};
+    int mMinThreads{0};
+    atomic<int> mActiveWorkers{0};
+    chrono::microseconds mLatencyThreshold{};
+    chrono::milliseconds mIdleTimeout{};
+    
+    thread mSupervisor{};
+    mutex mSupervisorMutex{};
+    condition_variable mSupervisorConditionVariable{};
+    bool mSupervisorDone{false};
+    
+    // delayed and periodic tasks
+    unique_ptr<TimerWheel> mTimers{};
+    
+#ifdef THREAD_POOL_TELEMETRY
+    // for the tasks run by threads other than our workers
+    TaskTelemetry mHelperTelemetry{};
+    atomic<uint64_t> mWakes{0};
+    
+    // to convert cycle_clock ticks into nanoseconds, by the time a snapshot is taken
+    uint64_t mStartTicks{cycle_clock::now()};
+    chrono::steady_clock::time_point mStartTime{chrono::steady_clock::now()};
+#endif
+    
+    // bounds on the number of spin iterations an idle worker does before it parks
+    static constexpr int MinSpin = 16;
+    static constexpr int MaxSpin = 4096;
+    
+    // busy wait (for at most *spinLimit* iterations) for new work to show up
+    bool spin(int spinLimit) const
+    {
+        for (int i = 0; i < spinLimit; ++i)
+        {
+            if (pending(memory_order_relaxed) > 0 || mDone.load(memory_order_relaxed))
+            {
+                return true;
+            }
+            
+            cpu_relax();
+        }
+        
+        return false;
+    }
+    
+    // wake up one sleeping worker, if there is any
+    // a pending count has been bumped before we look at mSleepers, and a worker bumps mSleepers before it sums up the
+    // pending counts (all sequentially consistent), so either we see the sleeper or the sleeper sees the new task: no lost
+    // wake ups
+    void wake_one()
+    {
+        if (mSleepers.load() > 0)
+        {
+#ifdef THREAD_POOL_TELEMETRY
+            mWakes.fetch_add(1, memory_order_relaxed);
+#endif
+            unique_lock<mutex> lk(mMutex);
+            mConditionVariable.notify_one();
+        }
+    }
+    
+    // the worker loop
+    // prefer the own deque, then the injection queue, then steal from the other workers
+    // (the discipline orders the injection queue; the own deque is always served last in, first out)
+    //
+    // an idle worker first spins for a while, and only parks on the condition variable if no work showed up meanwhile
+    // the spin budget adapts: it doubles whenever spinning paid off and halves whenever the worker had to park anyway,
+    // so bursty submissions are picked up without a wake up (and its syscall), while a quiet pool does not burn cpu
+    void run(size_t index)
+    {
+        tlsPool = this;
+        tlsWorkerIndex = index;
+        this_task::tlsAbort = &mAbort;
+        
+        if (!mWorkers[index]->mCpus.empty())
+        {
+            pin_current_thread(mWorkers[index]->mCpus);
+        }
+        
+        int spinLimit = MinSpin;
+        
+        while (true)
+        {
+            Task task = fetch(index);
+            
+            if (task)
+            {
+                // whatever a shutdown_now() did not get to clear out of the queues in time
+                if (mAbort.load(memory_order_relaxed))
+                {
+                    task.abandon(make_exception_ptr(task_cancelled()));
+                    continue;
+                }
+                
+#ifdef THREAD_POOL_TELEMETRY
+                mWorkers[index]->mTelemetry.found_work();
+                mWorkers[index]->mTelemetry.run(task, false);
+#else
+                task();
+#endif
+                
+                atomic<unsigned long long>& tasksRun = mWorkers[index]->mTasksRun;
+                tasksRun.store(tasksRun.load(memory_order_relaxed) + 1, memory_order_relaxed);
+                
+                continue;
+            }
+            
+#ifdef THREAD_POOL_TELEMETRY
+            mWorkers[index]->mTelemetry.found_none();
+#endif
+            
+            if (spin(spinLimit))
+            {
+                spinLimit = min(spinLimit * 2, MaxSpin);
+                
+                if (!mDone.load())
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                spinLimit = max(spinLimit / 2, MinSpin);
+            }
+            
+            unique_lock<mutex> lk(mMutex);
+            
+            auto workToDo = [this](){return mDone || pending() > 0;};
+            bool woken = true;
+            
+#ifdef THREAD_POOL_TELEMETRY
+            mWorkers[index]->mTelemetry.parked();
+#endif
+            
+            mSleepers.fetch_add(1);
+            if (mElastic)
+            {
+                woken = mConditionVariable.wait_for(lk, mIdleTimeout, workToDo);
+            }
+            else
+            {
+                mConditionVariable.wait(lk, workToDo);
+            }
+            mSleepers.fetch_sub(1);
+            
+            // on shutdown, leave only once every queue has been drained
+            if (mDone && pending() <= 0)
+            {
+                return;
+            }
+            
+            // idle for too long: leave, unless that would take the pool below its minimum size
+            // (the own deque is empty: only its owner pushes to it, and the owner just found nothing to do)
+            if (!woken && try_retire(index))
+            {
+                return;
+            }
+        }
+    }
+    
+    bool try_retire(size_t index)
+    {
+        int numActive = mActiveWorkers.load();
+        
+        while (numActive > mMinThreads)
+        {
+            if (mActiveWorkers.compare_exchange_weak(numActive, numActive - 1))
+            {
+                mWorkers[index]->mActive.store(false);
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    // start a worker in the given (vacant) slot
+    void start_worker(size_t index)
+    {
+        Worker& worker = *mWorkers[index];
+        
+        // a worker that retired from this slot may still be on its way out
+        if (worker.mThread.joinable())
+        {
+            worker.mThread.join();
+        }
+        
+        worker.mActive.store(true);
+        
+        {
+            unique_lock<mutex> lk(mExitMutex);
+            ++mRunning;
+        }
+        
+        // all threads in the thread pool continuously execute this method
+        worker.mThread = thread(
+            [this, index]()
+            {
+                run(index);
+                
+                unique_lock<mutex> lk(mExitMutex);
+                --mRunning;
+                mExitConditionVariable.notify_all();
+            });
+    }
+    
+    // every latencyThreshold, estimate the queueing latency from the number of queued tasks and the rate at which the
+    // workers have been starting tasks (Little's law: latency = queue length / throughput)
+    // no progress at all with tasks queued means an infinite latency (say, every worker is stuck in a long task)
+    // if the estimate exceeds the threshold, add a worker (just one per round, to not overshoot)
+    void supervise()
+    {
+        auto tick = max<chrono::microseconds>(mLatencyThreshold, chrono::milliseconds(1));
+        unsigned long long lastTasksRun{0};
+        
+        unique_lock<mutex> lk(mSupervisorMutex);
+        
+        while (!mSupervisorConditionVariable.wait_for(lk, tick, [this](){return mSupervisorDone;}))
+        {
+            // a retired worker is on its way out of run(); join it now, so that its stack goes away with it
+            // rather than once its slot gets reused
+            for (auto& pWorker : mWorkers)
+            {
+                if (!pWorker->mActive.load() && pWorker->mThread.joinable())
+                {
+                    pWorker->mThread.join();
+                }
+            }
+            
+            unsigned long long tasksRun{0};
+            for (auto& pWorker : mWorkers)
+            {
+                tasksRun += pWorker->mTasksRun.load(memory_order_relaxed);
+            }
+            
+            unsigned long long numStarted = tasksRun - lastTasksRun;
+            lastTasksRun = tasksRun;
+            
+            long numQueued = pending();
+            if (numQueued <= 0)
+            {
+                continue;
+            }
+            
+            bool tooSlow = (numStarted == 0) ||
+                (chrono::duration_cast<chrono::microseconds>(tick * numQueued / numStarted) > mLatencyThreshold);
+            
+            if (tooSlow && mActiveWorkers.load() < static_cast<int>(mWorkers.size()))
+            {
+                for (size_t i = 0; i < mWorkers.size(); ++i)
+                {
+                    if (!mWorkers[i]->mActive.load())
+                    {
+                        mActiveWorkers.fetch_add(1);
+                        start_worker(i);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    
+    Task fetch(size_t index)
+    {
+        Task task{};
+        
+        bool isWorker = index < mWorkers.size();
+        
+        auto popOwn = [this, index, &task]()
+        {
+            Worker& self = *mWorkers[index];
+            
+            unique_lock<mutex> lk(self.mMutex);
+            if (!self.mTasks.empty())
+            {
+                task = self.mTasks.pop_back();
+            }
+        };
+        
+        // the own deque first, unless the injection queues hold tasks more urgent than anything in there
+        bool ownFirst = mScheduling == scheduling::work_stealing && isWorker && mUrgentQueued.load(memory_order_relaxed) <= 0;
+        if (ownFirst)
+        {
+            popOwn();
+        }
+        
+        // the own node's queue first, then the other nodes' ones
+        size_t numNodes = mQueues.size();
+        size_t node = isWorker ? mWorkers[index]->mNode : 0;
+        
+        for (size_t i = 0; !task && i < numNodes; ++i)
+        {
+            if (mQueues[(node + i) % numNodes]->try_pop(task))
+            {
+                made_room();
+                
+                // the discipline hands out its most urgent task first (give or take aging), so count one off
+                long numUrgent = mUrgentQueued.load(memory_order_relaxed);
+                while (numUrgent > 0)
+                {
+                    if (mUrgentQueued.compare_exchange_weak(numUrgent, numUrgent - 1, memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+        
+        if (!task && !ownFirst && mScheduling == scheduling::work_stealing && isWorker)
+        {
+            popOwn();
+        }
+        
+        if (!task && mScheduling == scheduling::work_stealing)
+        {
+            task = steal(index);
+        }
+        
+        // (a helping thread counts the task off the first queue's count, whichever queue it came from: only the sum matters)
+        if (task)
+        {
+            (isWorker ? mWorkers[index]->mPending : mQueuePending[0].mValue).fetch_sub(1);
+        }
+        
+        return task;
+    }
+    
+    // visit the other workers in the order precomputed for the thief (the ones on its node first)
+    // (a thread that is not one of our workers passes mWorkers.size() as its index, and visits all of them)
+    // try_lock so that a thief never queues up behind an owner or another thief; a busy victim is skipped
+    Task steal(size_t index)
+    {
+        auto tryVictim = [this](size_t victimIndex)
+        {
+            Worker& victim = *mWorkers[victimIndex];
+            
+            if (!victim.mActive.load(memory_order_relaxed))
+            {
+                return Task{};
+            }
+            
+            unique_lock<mutex> lk(victim.mMutex, try_to_lock);
+            if (lk.owns_lock() && !victim.mTasks.empty())
+            {
+                return victim.mTasks.pop_front();
+            }
+            
+            return Task{};
+        };
+        
+        if (index < mWorkers.size())
+        {
+            for (size_t victimIndex : mWorkers[index]->mVictims)
+            {
+                if (Task task = tryVictim(victimIndex))
+                {
+#ifdef THREAD_POOL_TELEMETRY
+                    mWorkers[index]->mTelemetry.stolen();
+#endif
+                    return task;
+                }
+            }
+        }
+        else
+        {
+            for (size_t victimIndex = 0; victimIndex < mWorkers.size(); ++victimIndex)
+            {
+                if (Task task = tryVictim(victimIndex))
+                {
+                    return task;
+                }
+            }
+        }
+        
+        return Task{};
+    }
+    
+    // the node whose queue a task goes to: the hinted one, else the submitting worker's one, else the next one in turn
+    size_t target_node(locality hint) const
+    {
+        size_t numNodes = mQueues.size();
+        
+        // a hint for a node we have no queue for (one without cpus of ours, say) counts as no hint
+        if (hint.node >= 0)
+        {
+            auto it = find(mNodeIds.begin(), mNodeIds.end(), hint.node);
+            if (it != mNodeIds.end())
+            {
+                return static_cast<size_t>(it - mNodeIds.begin());
+            }
+        }
+        
+        if (on_worker_thread())
+        {
+            return mWorkers[tlsWorkerIndex]->mNode;
+        }
+        
+        return numNodes == 1 ? 0 : mNextNode.fetch_add(1, memory_order_relaxed) % numNodes;
+    }
+    
+    bool on_worker_thread() const
+    {
+        return tlsPool == this;
+    }
+    
+    // the count the calling thread accounts its submissions to: a worker's own one, else the one of the queue at *node*
+    atomic<long>& pending_count(size_t node)
+    {
+        return on_worker_thread() ? mWorkers[tlsWorkerIndex]->mPending : mQueuePending[node].mValue;
+    }
+    
+    // the number of tasks sitting in the injection queues and the worker deques
+    long pending(memory_order order = memory_order_seq_cst) const
+    {
+        long numPending = 0;
+        
+        for (auto& pWorker : mWorkers)
+        {
+            numPending += pWorker->mPending.load(order);
+        }
+        
+        for (size_t node = 0; node < mQueues.size(); ++node)
+        {
+            numPending += mQueuePending[node].mValue.load(order);
+        }
+        
+        return numPending;
+    }
+    
+    // what enqueue_task() wraps a callable and its arguments in
+    // an abandoned call hands the reason over to whoever waits on its future
+    template <
+        typename RetType,
+        typename F,
+        typename ArgsTuple>
+    struct Call
+    {
+        Promise<RetType> mPromise;
+        F mF;
+        ArgsTuple mArgs;
+        
+        void operator()()
+        {
+            auto invoke = [this](){return apply(mF, mArgs);};
+            mPromise.set_from(invoke);
+        }
+        
+        void abandon(exception_ptr reason)
+        {
+            mPromise.set_exception(move(reason));
+        }
+    };
+    
+#ifdef __cpp_impl_coroutine
+    // resumes a suspended coroutine on a worker
+    // just a handle (and where to report an abandonment), so it always fits inline in a Task
+    struct Resume
+    {
+        coroutine_handle<> mHandle;
+        exception_ptr* mError;
+        
+        void operator()()
+        {
+            mHandle.resume();
+        }
+        
+        // the coroutine still has to run, it gets to see why it was not scheduled
+        void abandon(exception_ptr reason)
+        {
+            *mError = move(reason);
+            mHandle.resume();
+        }
+    };
+    
+    // starts a detached task on a worker
+    template <
+        typename T>
+    struct Start
+    {
+        coroutine_handle<typename task<T>::promise_type> mHandle;
+        
+        void operator()()
+        {
+            mHandle.resume();
+        }
+        
+        // the task never started, so nobody but us is going to clean it up
+        void abandon(exception_ptr reason)
+        {
+            mHandle.promise().mPromise.set_exception(move(reason));
+            mHandle.destroy();
+        }
+    };
+#endif
+    
+    template <
+        typename Clock,
+        typename Duration>
+    static chrono::steady_clock::time_point steady_time(chrono::time_point<Clock, Duration> when)
+    {
+        if constexpr (is_same_v<Clock, chrono::steady_clock>)
+        {
+            return chrono::time_point_cast<chrono::steady_clock::duration>(when);
+        }
+        else
+        {
+            return chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(when - Clock::now());
+        }
+    }
+    
+    // a call that does not start if its token has been cancelled by the time a worker gets to it
+    // while it runs, the token is the one that this_task::cancellation_requested() polls
+    template <
+        typename CallType>
+    struct Guarded
+    {
+        cancellation_token mToken;
+        CallType mCall;
+        
+        void operator()()
+        {
+            if (mToken.is_cancelled())
+            {
+                mCall.abandon(make_exception_ptr(task_cancelled()));
+                return;
+            }
+            
+            // a worker that helps with other tasks while this one waits runs them with their own tokens
+            const cancellation_token* outer = exchange(this_task::tlsToken, &mToken);
+            mCall();
+            this_task::tlsToken = outer;
+        }
+        
+        void abandon(exception_ptr reason)
+        {
+            mCall.abandon(move(reason));
+        }
+    };
+    
+    // see drain() and shutdown_now()
+    // may be called any number of times (the destructor calls it once more), but not from within one of our tasks
+    bool stop(bool abort, chrono::milliseconds timeout)
+    {
+        if (on_worker_thread())
+        {
+            throw logic_error("a ThreadPool cannot be shut down from one of its own tasks");
+        }
+        
+        // the timers that have not fired yet never will
+        mTimers->stop();
+        
+        // no more workers from now on
+        if (mSupervisor.joinable())
+        {
+            {
+                unique_lock<mutex> lk(mSupervisorMutex);
+                mSupervisorDone = true;
+            }
+            
+            mSupervisorConditionVariable.notify_one();
+            mSupervisor.join();
+        }
+        
+        if (abort)
+        {
+            mAbort.store(true);
+        }
+        
+        {
+            unique_lock<mutex> lk(mMutex);
+            
+            // workers exit once they find nothing left to do in any of the queues
+            // every worker has to learn about it, so this is the one place where all of them get woken up (just once)
+            mDone = true;
+            mConditionVariable.notify_all();
+        }
+        
+        if (abort)
+        {
+            cancel_pending();
+        }
+        
+        {
+            unique_lock<mutex> lk(mExitMutex);
+            
+            auto allGone = [this](){return mRunning == 0;};
+            
+            if (timeout == chrono::milliseconds::max())
+            {
+                mExitConditionVariable.wait(lk, allGone);
+            }
+            else if (!mExitConditionVariable.wait_for(lk, timeout, allGone))
+            {
+                return false;
+            }
+        }
+        
+        // every thread (including the retired ones) is done, or on its very way out
+        for (auto& pWorker : mWorkers)
+        {
+            if (pWorker->mThread.joinable())
+            {
+                pWorker->mThread.join();
+            }
+        }
+        
+        // a submitter that raced with the shutdown may have got a task in after the workers left
+        cancel_pending();
+        
+        return true;
+    }
+    
+    // let a submitter blocked on a full bounded queue know that a task just left it
+    // like in wake_one(), the fence on either side makes sure that either we see the blocked submitter, or it sees the room
+    // with a queue per node, a blocked submitter may be waiting on another node's queue, so everyone gets to check
+    void made_room()
+    {
+        if constexpr (Discipline::bounded)
+        {
+            if constexpr (Discipline::policy == backpressure::block)
+            {
+                atomic_thread_fence(memory_order_seq_cst);
+                if (mBlockedSubmitters.load() > 0)
+                {
+                    unique_lock<mutex> lk(mRoomMutex);
+                    if (mQueues.size() == 1)
+                    {
+                        mRoomConditionVariable.notify_one();
+                    }
+                    else
+                    {
+                        mRoomConditionVariable.notify_all();
+                    }
+                }
+            }
+        }
+    }
+    
+    // put a task on the shared queue, applying the backpressure policy if a bounded one is full
+    // returns whether the task made it into the queue (rather than being rejected, or run by the caller)
+    // resolved at compile time: an unbounded discipline just pushes
+    bool push_shared(Task& task, const urgency& u, size_t node)
+    {
+        Discipline& queue = *mQueues[node];
+        
+        if constexpr (!Discipline::bounded)
+        {
+            queue.push(move(task), u);
+            return true;
+        }
+        else
+        {
+            if (queue.try_push(task, u))
+            {
+                return true;
+            }
+            
+            if constexpr (Discipline::policy == backpressure::reject)
+            {
+                task.abandon(make_exception_ptr(queue_full{}));
+                return false;
+            }
+            
+            // a worker waiting for the workers to make room may wait forever
+            if (Discipline::policy == backpressure::caller_runs || on_worker_thread())
+            {
+                task();
+                return false;
+            }
+            
+            if constexpr (Discipline::policy == backpressure::spin)
+            {
+                while (!queue.try_push(task, u))
+                {
+                    cpu_relax();
+                }
+                
+                return true;
+            }
+            else
+            {
+                unique_lock<mutex> lk(mRoomMutex);
+                
+                mBlockedSubmitters.fetch_add(1);
+                atomic_thread_fence(memory_order_seq_cst);
+                mRoomConditionVariable.wait(lk, [&](){return queue.try_push(task, u);});
+                mBlockedSubmitters.fetch_sub(1);
+                
+                return true;
+            }
+        }
+    }
+    
+    // whether a worker's own deque may take one more task (to be called with the worker's mutex held)
+    // with a bounded discipline, each deque is bounded by the capacity of the shared queue
+    bool has_room(const Worker& worker) const
+    {
+        if constexpr (Discipline::bounded)
+        {
+            return worker.mTasks.size() < Discipline::capacity;
+        }
+        else
+        {
+            return true;
+        }
+    }
+    
+    // once the pool is shutting down, it takes no more tasks, but for the ones that the backlog spawns while it drains
+    bool shutting_down() const
+    {
+        return mDone.load(memory_order_relaxed) && (mAbort.load(memory_order_relaxed) || !on_worker_thread());
+    }
+    
+    // whether a task may go to a worker's own deque, which knows nothing about priorities and deadlines
+    static bool is_default(const urgency& u)
+    {
+        return u.priority == 0 && !u.has_deadline();
+    }
+    
+    // account for tasks just pushed to an injection queue
+    void queued_urgent(const urgency& u, size_t numTasks)
+    {
+        if (mScheduling == scheduling::work_stealing && (u.priority > 0 || u.has_deadline()))
+        {
+            mUrgentQueued.fetch_add(static_cast<long>(numTasks), memory_order_relaxed);
+        }
+    }
+    
+    // record when the task got queued, for the queue wait histogram (a no-op without telemetry)
+    static void stamp(Task& task)
+    {
+#ifdef THREAD_POOL_TELEMETRY
+        task.set_queued_at(TaskTelemetry::stamp());
+#else
+        (void)task;
+#endif
+    }
+    
+    void submit(Task task, const urgency& u, locality hint = locality{})
+    {
+        if (shutting_down())
+        {
+            task.abandon(make_exception_ptr(task_cancelled()));
+            return;
+        }
+        
+        stamp(task);
+        
+        // a task submitted from within one of our workers goes to that worker's own deque
+        // unless that is full, which only a bounded discipline's deques can be; then it goes through the backpressure policy like any other
+        // (the deques are plain LIFOs: a task with a priority or a deadline goes to the discipline, which orders it)
+        if (mScheduling == scheduling::work_stealing && on_worker_thread() && is_default(u))
+        {
+            Worker& self = *mWorkers[tlsWorkerIndex];
+            
+            bool pushed = false;
+            {
+                unique_lock<mutex> lk(self.mMutex);
+                if (has_room(self))
+                {
+                    self.mTasks.push_back(move(task));
+                    pushed = true;
+                }
+            }
+            
+            if (pushed)
+            {
+                self.mPending.fetch_add(1);
+                wake_one();
+                
+                return;
+            }
+        }
+        
+        // one task needs one worker: waking up all of them would just have them fight over it
+        size_t node = target_node(hint);
+        if (push_shared(task, u, node))
+        {
+            queued_urgent(u, 1);
+            pending_count(node).fetch_add(1);
+            wake_one();
+        }
+    }
+    
+    // push makeTask(*it) for every element in [first, last) with a single lock acquisition
+    // then wake up as many sleeping workers as there are new tasks, and no more
+    //
+    // a bounded queue (or, in work_stealing mode, a worker's deque) may fill up half way through the batch, and a submitter
+    // waiting for room must have made the tasks it pushed so far visible to the workers first, so there the batch degrades
+    // to one submission per element
+    template <
+        typename It,
+        typename MakeTask>
+    void submit_batch(It first, It last, size_t numTasks, MakeTask& makeTask, const urgency& u, locality hint)
+    {
+        auto makeStamped = [&makeTask](const auto& element)
+        {
+            Task task = makeTask(element);
+            stamp(task);
+            return task;
+        };
+        
+        if (shutting_down())
+        {
+            for (; first != last; ++first)
+            {
+                makeTask(*first).abandon(make_exception_ptr(task_cancelled()));
+            }
+            
+            return;
+        }
+        
+        if constexpr (Discipline::bounded)
+        {
+            for (; first != last; ++first)
+            {
+                submit(makeTask(*first), u, hint);
+            }
+            
+            return;
+        }
+        
+        size_t node = 0;
+        
+        if (mScheduling == scheduling::work_stealing && on_worker_thread() && is_default(u))
+        {
+            Worker& self = *mWorkers[tlsWorkerIndex];
+            
+            unique_lock<mutex> lk(self.mMutex);
+            for (; first != last; ++first)
+            {
+                self.mTasks.push_back(makeStamped(*first));
+            }
+        }
+        else
+        {
+            if constexpr (!Discipline::bounded)
+            {
+                node = target_node(hint);
+                mQueues[node]->push_batch(first, last, makeStamped, u);
+                queued_urgent(u, numTasks);
+            }
+        }
+        
+        pending_count(node).fetch_add(static_cast<long>(numTasks));
+        
+        if (mSleepers.load() > 0)
+        {
+            unique_lock<mutex> lk(mMutex);
+            
+            size_t numSleepers = static_cast<size_t>(mSleepers.load());
+            if (numTasks >= numSleepers)
+            {
+                mConditionVariable.notify_all();
+            }
+            else
+            {
+                for (size_t i = 0; i < numTasks; ++i)
+                {
+                    mConditionVariable.notify_one();
+                }
+            }
+        }
+    }
+    
+    // run one pending task (if there is any) on the calling thread
+    // lets a thread that waits for a bunch of tasks help with them rather than just block
+    bool run_pending_task()
+    {
+        Task task = fetch(on_worker_thread() ? tlsWorkerIndex : mWorkers.size());
+        
+        if (!task)
+        {
+            return false;
+        }
+        
+#ifdef THREAD_POOL_TELEMETRY
+        if (on_worker_thread())
+        {
+            mWorkers[tlsWorkerIndex]->mTelemetry.run(task, false);
+        }
+        else
+        {
+            mHelperTelemetry.run(task, true);
+        }
+#else
+        task();
+#endif
+        return true;
+    }
+    
+    // the bookkeeping of a parallel_for/parallel_reduce in flight
+    // lives on the stack of the calling thread, which waits until every element has been processed
+    template <
+        typename Index,
+        typename Leaf>
+    struct RangeState
+    {
+        Leaf& mLeaf;
+        size_t mGrain;
+        
+        atomic<size_t> mRemaining;
+        Promise<void> mDone{};
+        
+        mutex mMutex{};
+        exception_ptr mException{};
+        
+        RangeState(Leaf& leaf, size_t grain, size_t numElements)
+        : mLeaf(leaf), mGrain(grain), mRemaining(numElements) {}
+    };
+    
+    // recursively split [first, last) in halves until it is no bigger than the grain, handing the right halves over to the pool
+    // and processing the leftmost piece right away (in the work stealing mode, the right halves are what the thieves get,
+    // so the idle workers pick up big chunks of the range, and split them further themselves)
+    template <
+        typename Index,
+        typename Leaf>
+    void split_range(RangeState<Index, Leaf>* state, Index first, Index last)
+    {
+        while (static_cast<size_t>(last - first) > state->mGrain)
+        {
+            Index middle = first + (last - first) / 2;
+            
+            // a piece that the pool turns down gets processed on the spot
+            auto piece = [this, state, middle, last](){split_range(state, middle, last);};
+            submit(Task(piece, [piece](exception_ptr) mutable {piece();}), urgency{});
+            
+            last = middle;
+        }
+        
+        try
+        {
+            state->mLeaf(first, last);
+        }
+        catch (...)
+        {
+            unique_lock<mutex> lk(state->mMutex);
+            if (!state->mException)
+            {
+                state->mException = current_exception();
+            }
+        }
+        
+        size_t numElements = static_cast<size_t>(last - first);
+        if (state->mRemaining.fetch_sub(numElements) == numElements)
+        {
+            // the caller may tear the state down as soon as the promise is fulfilled, so fulfil a promise of our own
+            Promise<void> done(move(state->mDone));
+            done.set_value();
+        }
+    }
+    
+    // call leaf(b, e) over disjoint pieces [b, e) that together cover [first, last), in parallel
+    // the calling thread takes part, and returns once all pieces have been processed
+    template <
+        typename Index,
+        typename Leaf>
+    void for_each_piece(Index first, Index last, size_t grain, Leaf& leaf)
+    {
+        if (!(first < last))
+        {
+            return;
+        }
+        
+        RangeState<Index, Leaf> state(leaf, grain == 0 ? 1 : grain, static_cast<size_t>(last - first));
+        Future<void> done = state.mDone.get_future();
+        
+        split_range(&state, first, last);
+        
+        // help with the pieces still queued, and only block once there is nothing left to run
+        while (!done.is_ready() && run_pending_task())
+        {
+        }
+        
+        done.get();
+        
+        if (state.mException)
+        {
+            rethrow_exception(state.mException);
+        }
+    }
+    
+public:
+
+    ThreadPool(int numThreads = std::thread::hardware_concurrency(), scheduling mode = scheduling::shared_queue)
+    : ThreadPool(pool_options{numThreads, mode}) {}
+    
+    explicit ThreadPool(const pool_options& options)
+    : mScheduling(options.mode)
+    {
+        int numThreads = options.numThreads;
+        cout << "hardware_concurrency = " << numThreads << '\n';
+        
+        // an elastic pool has a slot for as many workers as it may grow to, vacant to begin with
+        // (and at least one worker, or there would be nobody left to notice new work)
+        mElastic = options.maxThreads > numThreads;
+        mMinThreads = mElastic ? max(numThreads, 1) : numThreads;
+        mLatencyThreshold = options.latencyThreshold;
+        mIdleTimeout = options.idleTimeout;
+        
+        mTimers = make_unique<TimerWheel>(executor(), options.timerTick);
+        
+        int numSlots = mElastic ? options.maxThreads : numThreads;
+        
+        cpu_topology topology = cpu_topology::detect();
+        
+        size_t numNodes = options.numaAware ? topology.num_nodes() : 1;
+        mQueuePending = make_unique<QueueCount[]>(numNodes);
+        for (size_t node = 0; node < numNodes; ++node)
+        {
+            mQueues.emplace_back(make_unique<Discipline>());
+            
+            if (options.numaAware)
+            {
+                mNodeIds.push_back(topology.node_id(node));
+            }
+        }
+        
+        vector<int> pinCpus = options.cpus.empty() ? topology.all_cpus() : options.cpus;
+        vector<size_t> numWorkersOnNode(numNodes, 0);
+        
+        // all workers must exist before any of them starts, since a thief may visit any of them
+        for (int i = 0; i < numSlots; ++i)
+        {
+            auto pWorker = make_unique<Worker>();
+            
+            if (options.numaAware)
+            {
+                pWorker->mNode = static_cast<size_t>(i) % numNodes;
+                
+                const vector<int>& nodeCpus = topology.cpus(pWorker->mNode);
+                size_t k = numWorkersOnNode[pWorker->mNode]++;
+                
+                pWorker->mCpus = options.pinWorkers ? vector<int>{nodeCpus[k % nodeCpus.size()]} : nodeCpus;
+            }
+            else if (options.pinWorkers && !pinCpus.empty())
+            {
+                pWorker->mCpus = {pinCpus[static_cast<size_t>(i) % pinCpus.size()]};
+            }
+            
+            mWorkers.emplace_back(move(pWorker));
+        }
+        
+        for (size_t i = 0; i < mWorkers.size(); ++i)
+        {
+            for (bool sameNode : {true, false})
+            {
+                for (size_t j = 1; j < mWorkers.size(); ++j)
+                {
+                    size_t victimIndex = (i + j) % mWorkers.size();
+                    if ((mWorkers[victimIndex]->mNode == mWorkers[i]->mNode) == sameNode)
+                    {
+                        mWorkers[i]->mVictims.push_back(victimIndex);
+                    }
+                }
+            }
+        }
+        
+        mActiveWorkers.store(mMinThreads);
+        for (int i = 0; i < mMinThreads; ++i)
+        {
+            start_worker(static_cast<size_t>(i));
+        }
+        
+        if (mElastic)
+        {
+            mSupervisor = thread([this](){supervise();});
+        }
+    }
+    
+    // unless shut down already, finish the backlog first, however long that takes
+    ~ThreadPool()
+    {
+        stop(false, chrono::milliseconds::max());
+    }
+    
+    // the number of workers currently running (fixed, unless the pool is elastic)
+    int num_workers() const
+    {
+        return mActiveWorkers.load();
+    }
+    
+#ifdef THREAD_POOL_TELEMETRY
+    // a snapshot of the telemetry; may be taken any time, from any thread, without disturbing the workers
+    // (the busy time of a worker in the middle of a busy stretch is only accounted for once the stretch ends)
+    pool_stats stats() const
+    {
+        pool_stats stats{};
+        
+        auto elapsed = chrono::steady_clock::now() - mStartTime;
+        uint64_t elapsedTicks = cycle_clock::now() - mStartTicks;
+        double nanosPerTick = elapsedTicks ? chrono::duration<double, nano>(elapsed).count() / static_cast<double>(elapsedTicks) : 1.0;
+        
+        vector<uint64_t> queueWait(AtomicHistogram::NumBuckets, 0);
+        vector<uint64_t> runTime(AtomicHistogram::NumBuckets, 0);
+        uint64_t busyTicks{0};
+        
+        auto add = [&](const TaskTelemetry& telemetry)
+        {
+            telemetry.mQueueWait.add_to(queueWait);
+            telemetry.mRunTime.add_to(runTime);
+            stats.tasks += telemetry.mTasks.load(memory_order_relaxed);
+            stats.steals += telemetry.mSteals.load(memory_order_relaxed);
+            stats.parks += telemetry.mParks.load(memory_order_relaxed);
+            busyTicks += telemetry.mBusy.load(memory_order_relaxed);
+        };
+        
+        for (auto& pWorker : mWorkers)
+        {
+            add(pWorker->mTelemetry);
+        }
+        add(mHelperTelemetry);
+        
+        stats.queueWait = histogram(move(queueWait), nanosPerTick);
+        stats.runTime = histogram(move(runTime), nanosPerTick);
+        stats.wakes = mWakes.load(memory_order_relaxed);
+        
+        stats.elapsed = chrono::duration_cast<chrono::nanoseconds>(elapsed);
+        stats.busy = chrono::nanoseconds(static_cast<long long>(static_cast<double>(busyTicks) * nanosPerTick));
+        stats.workers = num_workers();
+        
+        if (stats.workers > 0 && stats.elapsed.count() > 0)
+        {
+            stats.utilization = static_cast<double>(stats.busy.count()) / (static_cast<double>(stats.elapsed.count()) * stats.workers);
+        }
+        
+        return stats;
+    }
+#endif
+    
+#ifdef __cpp_impl_coroutine
+    // co_await pool.schedule() moves the rest of the coroutine onto the pool
+    // the queued task holds just the coroutine handle, so suspending and resuming allocates nothing
+    // if a bounded queue turns the coroutine down, it resumes right away and the co_await throws queue_full
+    auto schedule(urgency u = urgency{})
+    {
+        struct Awaiter
+        {
+            ThreadPool& mPool;
+            urgency mUrgency;
+            exception_ptr mError{};
+            
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+            
+            void await_suspend(coroutine_handle<> h)
+            {
+                // the coroutine may be resumed (and this awaiter be gone) before submit() returns
+                ThreadPool& pool = mPool;
+                urgency u = mUrgency;
+                pool.submit(Task(Resume{h, &mError}), u);
+            }
+            
+            void await_resume()
+            {
+                if (mError)
+                {
+                    rethrow_exception(mError);
+                }
+            }
+        };
+        
+        return Awaiter{*this, u};
+    }
+    
+    // start *t* on the pool, detached; the returned future carries its result
+    template <
+        typename T>
+    Future<T> spawn(task<T> t, urgency u = urgency{})
+    {
+        auto h = exchange(t.mHandle, nullptr);
+        h.promise().mDetached = true;
+        h.promise().mPromise.set_executor(executor());
+        
+        Future<T> fut = move(t.mFuture);
+        submit(Task(Start<T>{h}), u);
+        
+        return fut;
+    }
+#endif
+    
+    // schedules continuations (Future::then) on this pool
+    // the pool must outlive any future that still has a continuation pending
+    Executor executor()
+    {
+        return Executor{this, [](void* context, Task task)
+        {
+            static_cast<ThreadPool*>(context)->submit(move(task), urgency{});
+        }};
+    }
+     
+    template<
+        typename F,
+        typename... Args>
+    auto enqueue_task(F&& f, Args&&... args) 
+    {
+        return enqueue_task(urgency{}, forward<F>(f), forward<Args>(args)...);
+    }
+    
+    template<
+        typename F,
+        typename... Args>
+    auto enqueue_task(priority prio, F&& f, Args&&... args) 
+    {
+        return enqueue_task(urgency{prio}, forward<F>(f), forward<Args>(args)...);
+    }
+    
+    // the lane and/or deadline of the task only matter to the deadline_lanes discipline (its priority, to the others too)
+    template<
+        typename F,
+        typename... Args>
+    auto enqueue_task(urgency u, F&& f, Args&&... args) 
+    {
+        return enqueue_task(locality{}, u, forward<F>(f), forward<Args>(args)...);
+    }
+    
+    // in a NUMA aware pool, the task goes to the queue of the hinted node, whose workers get to it first
+    template<
+        typename F,
+        typename... Args>
+    auto enqueue_task(locality hint, F&& f, Args&&... args) 
+    {
+        return enqueue_task(hint, urgency{}, forward<F>(f), forward<Args>(args)...);
+    }
+    
+    template<
+        typename F,
+        typename... Args>
+    auto enqueue_task(locality hint, urgency u, F&& f, Args&&... args) 
+    { 
+        // we have a callable *F* and a variadic parameter *args*
+        // we shall create a Task which shall wrap around a callable that would call F with (decayed copies of) the variadic parameter *args*
+        // and fulfil a Promise with the result, much like bind + packaged_task would do
+        // unlike the latter, a small callable is stored inline in the Task and the Promise/Future state is recycled,
+        // so that submitting a small callable does not allocate in steady state
+        using RetType = invoke_result_t<decay_t<F>&, decay_t<Args>&...>;
+        
+        Call<RetType, decay_t<F>, tuple<decay_t<Args>...>> call{Promise<RetType>{}, forward<F>(f), make_tuple(forward<Args>(args)...)};
+        call.mPromise.set_executor(executor());
+        Future<RetType> fut = call.mPromise.get_future();
+        
+        submit(Task(move(call)), u, hint);
+        
+        return fut;
+    }
+    
+    // the task does not start if *token* is cancelled by then (its future fails with task_cancelled),
+    // and may poll this_task::cancellation_requested() while it runs
+    template<
+        typename F,
+        typename... Args>
+    auto enqueue_task(cancellation_token token, F&& f, Args&&... args)
+    {
+        return enqueue_task(move(token), urgency{}, forward<F>(f), forward<Args>(args)...);
+    }
+    
+    template<
+        typename F,
+        typename... Args>
+    auto enqueue_task(cancellation_token token, urgency u, F&& f, Args&&... args)
+    {
+        using RetType = invoke_result_t<decay_t<F>&, decay_t<Args>&...>;
+        using CallType = Call<RetType, decay_t<F>, tuple<decay_t<Args>...>>;
+        
+        CallType call{Promise<RetType>{}, forward<F>(f), make_tuple(forward<Args>(args)...)};
+        call.mPromise.set_executor(executor());
+        Future<RetType> fut = call.mPromise.get_future();
+        
+        submit(Task(Guarded<CallType>{move(token), move(call)}), u);
+        
+        return fut;
+    }
+    
+    // run f(args...) on a worker once *delay* has passed, rather than have a worker sleep through it
+    // cancelling the timer (cancel_timer(future.timer())) before it fires fails the future with task_cancelled
+    template<
+        typename Rep,
+        typename Period,
+        typename F,
+        typename... Args>
+    auto enqueue_after(chrono::duration<Rep, Period> delay, F&& f, Args&&... args)
+    {
+        return enqueue_at(chrono::steady_clock::now() + delay, forward<F>(f), forward<Args>(args)...);
+    }
+    
+    template<
+        typename Clock,
+        typename Duration,
+        typename F,
+        typename... Args>
+    auto enqueue_at(chrono::time_point<Clock, Duration> when, F&& f, Args&&... args)
+    {
+        using RetType = invoke_result_t<decay_t<F>&, decay_t<Args>&...>;
+        
+        Call<RetType, decay_t<F>, tuple<decay_t<Args>...>> call{Promise<RetType>{}, forward<F>(f), make_tuple(forward<Args>(args)...)};
+        call.mPromise.set_executor(executor());
+        Future<RetType> fut = call.mPromise.get_future();
+        
+        timer_id id = mTimers->arm(steady_time(when), chrono::nanoseconds::zero(), Task(move(call)));
+        
+        return TimedFuture<RetType>(move(fut), id);
+    }
+    
+    // run fn() on a worker every *period*, starting one period from now, until the timer gets cancelled
+    // runs never overlap: the next one is due one period after the previous one was, or right away if that has passed
+    // a run that throws ends the schedule
+    template<
+        typename Rep,
+        typename Period,
+        typename F>
+    timer_id enqueue_every(chrono::duration<Rep, Period> period, F&& fn)
+    {
+        auto interval = chrono::duration_cast<chrono::nanoseconds>(period);
+        return mTimers->arm(chrono::steady_clock::now() + interval, interval, Task(forward<F>(fn)));
+    }
+    
+    // returns whether the timer was still live (see TimerWheel::cancel)
+    bool cancel_timer(timer_id id)
+    {
+        return mTimers->cancel(id);
+    }
+    
+    // enqueue fn(element) for every element of the range, with one lock acquisition and as many wake ups as are needed
+    // the returned future becomes ready once all of them have run (and carries the first exception thrown, if any)
+    template <
+        typename Range,
+        typename F>
+    Future<void> enqueue_batch(const Range& range, F&& fn, urgency u = urgency{}, locality hint = locality{})
+    {
+        using Element = decay_t<decltype(*std::begin(range))>;
+        
+        struct BatchState
+        {
+            decay_t<F> mFn;
+            atomic<size_t> mRemaining;
+            Promise<void> mDone{};
+            
+            mutex mMutex{};
+            exception_ptr mException{};
+            
+            void fail(exception_ptr e)
+            {
+                unique_lock<mutex> lk(mMutex);
+                if (!mException)
+                {
+                    mException = move(e);
+                }
+            }
+            
+            // the last task of the batch to finish fulfils the promise and deletes the state
+            void finish()
+            {
+                if (mRemaining.fetch_sub(1) == 1)
+                {
+                    if (mException)
+                    {
+                        mDone.set_exception(move(mException));
+                    }
+                    else
+                    {
+                        mDone.set_value();
+                    }
+                    
+                    delete this;
+                }
+            }
+        };
+        
+        size_t numTasks = static_cast<size_t>(distance(std::begin(range), std::end(range)));
+        
+        if (numTasks == 0)
+        {
+            Promise<void> done{};
+            done.set_executor(executor());
+            done.set_value();
+            return done.get_future();
+        }
+        
+        // owned by the tasks of the batch; the last one to finish deletes it
+        BatchState* state = new BatchState{forward<F>(fn), numTasks};
+        state->mDone.set_executor(executor());
+        Future<void> fut = state->mDone.get_future();
+        
+        auto makeTask = [state](const Element& element)
+        {
+            return Task(
+                [state, element]()
+                {
+                    try
+                    {
+                        state->mFn(element);
+                    }
+                    catch (...)
+                    {
+                        state->fail(current_exception());
+                    }
+                    
+                    state->finish();
+                },
+                [state](exception_ptr reason)
+                {
+                    state->fail(move(reason));
+                    state->finish();
+                });
+        };
+        
+        submit_batch(std::begin(range), std::end(range), numTasks, makeTask, u, hint);
+        
+        return fut;
+    }
+    
+    // call fn(i) for every i in [first, last), an integral or random access iterator range
+    // the range gets split recursively down to pieces of *grain* elements that run as pool tasks, with no per element futures
+    // blocks until done (the calling thread helps); rethrows the first exception thrown by fn, if any
+    template <
+        typename Index,
+        typename F>
+    void parallel_for(Index first, Index last, size_t grain, F&& fn)
     {
-   
-    public:
+        auto leaf = [&fn](Index b, Index e)
+        {
+            for (; b != e; ++b)
+            {
+                fn(b);
+            }
+        };
+        
+        for_each_piece(first, last, grain, leaf);
+    }
     
-        ~Job() noexcept = default;
-        virtual void execute() = 0;
-    };
+    // reduce(... reduce(identity, map(first)) ..., map(last - 1)) for [first, last), computed in parallel like parallel_for
+    // each piece gets reduced on its own, and the partial results get combined in whatever order the pieces finish,
+    // so reduce must be associative and commutative, and identity must be its identity element
+    template <
+        typename Index,
+        typename T,
+        typename Map,
+        typename Reduce>
+    T parallel_reduce(Index first, Index last, size_t grain, T identity, Map&& map, Reduce&& reduce)
+    {
+        mutex resultMutex{};
+        T result = identity;
+        
+        auto leaf = [&](Index b, Index e)
+        {
+            T partial = identity;
+            for (; b != e; ++b)
+            {
+                partial = reduce(move(partial), map(b));
+            }
+            
+            unique_lock<mutex> lk(resultMutex);
+            result = reduce(move(result), move(partial));
+        };
+        
+        for_each_piece(first, last, grain, leaf);
+        
+        return result;
+    }
     
-    // a specific job with a concrete return type
+    // the number of tasks so far that started after their deadline (for a discipline that keeps track of it)
     template <
-        typename RetType>
-    class AnyJob : public Job 
+        typename D = Discipline>
+    auto deadline_misses() const -> decltype(declval<const D&>().deadline_misses())
     {
+        decltype(declval<const D&>().deadline_misses()) numMisses{};
+        for (auto& pQueue : mQueues)
+        {
+            numMisses += pQueue->deadline_misses();
+        }
         
-    private:
+        return numMisses;
+    }
     
-        // the callable under the hood of the packaged_task shall 
-        // invoke the real callable with all required arguments
-        std::packaged_task<RetType()> func;
+    // drop every task that has not started yet; their futures fail with task_cancelled
+    // (the pieces of a parallel_for in flight can't be dropped, since its caller waits for every element: they get run right here,
+    // on the cancelling thread, along with whatever they split off, so cancelling amid a big parallel_for may take a while)
+    // the tasks get abandoned once out of the queues, since abandoning one may run a continuation that submits more
+    void cancel_pending()
+    {
+        RingDeque<Task> dropped{};
+        
+        for (auto& pWorker : mWorkers)
+        {
+            unique_lock<mutex> lk(pWorker->mMutex);
+            while (!pWorker->mTasks.empty())
+            {
+                dropped.push_back(pWorker->mTasks.pop_front());
+            }
+        }
+        
+        for (auto& pQueue : mQueues)
+        {
+            pQueue->clear(dropped);
+        }
         
-    public:
+        mUrgentQueued.store(0, memory_order_relaxed);
+        mQueuePending[0].mValue.fetch_sub(static_cast<long>(dropped.size()));
+        made_room();
+        
+        exception_ptr reason = make_exception_ptr(task_cancelled());
+        while (!dropped.empty())
+        {
+            dropped.pop_front().abandon(reason);
+        }
+    }
+    
+    // stop taking tasks, run the ones already queued (and whatever they spawn) to completion, and let the workers go
+    // timers that have not fired yet get cancelled
+    // returns whether all workers were gone within *timeout*; if not, they are left to finish (the destructor waits for
+    // them), so that a caller in a hurry (say, a deploy) may terminate the process instead
+    bool drain(chrono::milliseconds timeout = chrono::milliseconds::max())
+    {
+        return stop(false, timeout);
+    }
+    
+    // like drain(), but drop the tasks that have not started yet (their futures fail with task_cancelled), and ask the
+    // running ones to stop (this_task::cancellation_requested())
+    bool shutdown_now(chrono::milliseconds timeout = chrono::milliseconds::max())
+    {
+        return stop(true, timeout);
+    }
+};
+
+// structured fork-join: run() hands tasks over to the pool, wait() returns once all of them are done
+// rather than block, the waiting thread runs the group's tasks that no worker has picked up yet (most recent first), and
+// then helps with whatever else the pool has pending. a task that waits for a nested group therefore never ties up its
+// worker, and recursive divide and conquer works on a fixed size pool, no matter how deep the recursion
+//
+// the first exception thrown by a task cancels the group (the tasks that have not started yet are skipped), and is
+// rethrown by wait(). the running tasks may poll this_task::cancellation_requested(), which cancel() also triggers
+template <
+    typename Pool>
+class task_group
+{
+    // a task of the group, listed with the group and queued with the pool at the same time
+    // whoever claims it first runs it; it goes back to the Slab once both have let go of it
+    struct Entry
+    {
+        Entry* mNextFree{nullptr};
+        atomic<int> mRefs{0};
+        atomic<bool> mClaimed{false};
+        Task mTask{};
+    };
     
-        AnyJob(std::packaged_task<RetType()> func) : func(std::move(func)) {}
+    // what the pool runs: the entry's task, unless the waiting thread got to it first
+    struct Claim
+    {
+        task_group* mGroup;
+        Entry* mEntry;
         
-        virtual void execute() 
+        void operator()()
         {
-            func();
+            mGroup->try_run(mEntry);
+            release(mEntry);
         }
-    }; 
+        
+        // the entry is still listed with the group, whose wait() runs it instead
+        void abandon(exception_ptr)
+        {
+            release(mEntry);
+        }
+    };
+    
+    Pool& mPool;
+    
+    cancellation_source mSource{};
+    cancellation_token mToken{mSource.token()};
     
     mutex mMutex{};
     condition_variable mConditionVariable{};
-    vector<thread> mThreadPool{};
-    deque<shared_ptr<Job>> mTasks{};
     
-public:
-
-    ThreadPool(int numThreads = std::thread::hardware_concurrency())
+    // guarded by mMutex
+    // the entries that the waiting thread may still have to run (some of them claimed by a worker meanwhile), and the
+    // number of tasks not done yet; a task is done once mRemaining says so, so that the group may go away right then
+    vector<Entry*> mUnclaimed{};
+    size_t mRemaining{0};
+    exception_ptr mException{};
+    
+    static void release(Entry* entry)
     {
-        cout << "hardware_concurrency = " << numThreads << '\n';
+        if (entry->mRefs.fetch_sub(1, memory_order_acq_rel) == 1)
+        {
+            entry->mTask = Task{};
+            Slab<Entry>::release(entry);
+        }
+    }
+    
+    void try_run(Entry* entry)
+    {
+        if (entry->mClaimed.exchange(true, memory_order_acq_rel))
+        {
+            return;
+        }
         
-        for (int i = 0; i < numThreads; ++i)
+        if (!mToken.is_cancelled())
         {
-            mThreadPool.emplace_back(
-                thread( 
-                    // all threads in the thread pool continuously execute this method
-                    [this] ()
+            const cancellation_token* outer = exchange(this_task::tlsToken, &mToken);
+            
+            try
+            {
+                entry->mTask();
+            }
+            catch (...)
+            {
+                {
+                    unique_lock<mutex> lk(mMutex);
+                    if (!mException)
                     {
-                        while (true)
-                        {
-                            shared_ptr<Job> pTask{};
-                            {
-                                unique_lock<mutex> lk(mMutex);
-                                mConditionVariable.wait(lk, [&](){return !mTasks.empty();});
-                                pTask = mTasks.back(); mTasks.pop_back();
-                                
-                                // if we fetch a null job, it means we are shutting down
-                                // add a null job in the job queue that would subsequently be
-                                // fetched by some other thread in the pool
-                                // also, issue a wake up call for sleeping threads
-                                if (pTask == nullptr)
-                                {
-                                    mTasks.push_back(nullptr);
-                                    mConditionVariable.notify_all();
-        
-                                    return;
-                                }
-                            }
-                            
-                            pTask->execute();
+                        mException = current_exception();
                     }
-            }));
+                }
+                
+                mSource.cancel();
+            }
+            
+            this_task::tlsToken = outer;
+        }
+        
+        unique_lock<mutex> lk(mMutex);
+        if (--mRemaining == 0)
+        {
+            mConditionVariable.notify_all();
         }
     }
     
-    ~ThreadPool()
+    // the most recently added entry, whose data is the most likely to still be in cache
+    Entry* pop()
     {
+        unique_lock<mutex> lk(mMutex);
+        
+        if (mUnclaimed.empty())
         {
-            unique_lock<mutex> lk(mMutex);
-            
-            // enqueue a null job
-            // the thread that picks up this job shall 
-            // enqueue a null job for the next and so on
-            // ultimately, all threads shall exit
-            mTasks.push_back(nullptr);
-            mConditionVariable.notify_one();
+            return nullptr;
         }
         
-        for (thread& t : mThreadPool)
+        Entry* entry = mUnclaimed.back();
+        mUnclaimed.pop_back();
+        return entry;
+    }
+    
+public:
+
+    explicit task_group(Pool& pool) : mPool(pool) {}
+    
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+    
+    // the tasks refer to the group, so it cannot go away before they are done
+    ~task_group()
+    {
+        try
+        {
+            wait();
+        }
+        catch (...)
         {
-            // wait for all threads to have fetched the null job and exit
-            t.join();
         }
     }
-     
-    template<
-        typename F,
-        typename... Args>
-    future<result_of_t<F(Args...)>> enqueue_task(F&& f, Args&&... args) 
-    { 
-        // we have a callable *F* and a variadic parameter *args*
-        // we shall create a packaged_task which shall wrap around a callable that would call F with the variadic parameter *args*
-        // that callable shall be produced via a call to bind with *F* and *args* as the arguments
-        // the packaged_task template argument is <RetType()>, where RetType is the type of the result produced
-        // by the callable F when invoked with the variadic parameter *args*
-        using RetType = result_of_t<F(Args...)>;
+    
+    template <
+        typename F>
+    void run(F&& fn)
+    {
+        Entry* entry = Slab<Entry>::acquire();
+        entry->mRefs.store(2, memory_order_relaxed);
+        entry->mClaimed.store(false, memory_order_relaxed);
+        entry->mTask = Task(forward<F>(fn));
+        
+        {
+            unique_lock<mutex> lk(mMutex);
+            mUnclaimed.push_back(entry);
+            ++mRemaining;
+        }
         
-        packaged_task<RetType()> p(move(bind(forward<F>(f), forward<Args>(args)...)));
-        future<RetType> fut = p.get_future();
+        // a waiter with nothing left to run may be blocked
+        mConditionVariable.notify_all();
         
+        mPool.submit(Task(Claim{this, entry}), urgency{});
+    }
+    
+    // returns once every task run so far is done (and the group is ready for another round)
+    // rethrows the first exception thrown by any of them
+    void wait()
+    {
+        while (true)
         {
-            unique_lock<mutex> lk(mMutex);   
-            mTasks.emplace_back(make_shared<AnyJob<RetType>>(move(p)));
-            mConditionVariable.notify_all();
+            if (Entry* entry = pop())
+            {
+                try_run(entry);
+                release(entry);
+                continue;
+            }
+            
+            {
+                unique_lock<mutex> lk(mMutex);
+                if (mRemaining == 0)
+                {
+                    break;
+                }
+            }
+            
+            // the rest is running on workers: help with other work meanwhile, and only block once there is none
+            if (mPool.run_pending_task())
+            {
+                continue;
+            }
+            
+            unique_lock<mutex> lk(mMutex);
+            mConditionVariable.wait(lk, [this](){return mRemaining == 0 || !mUnclaimed.empty();});
         }
         
-        return fut;
+        exception_ptr e = exchange(mException, nullptr);
+        
+        if (mToken.is_cancelled())
+        {
+            mSource = cancellation_source{};
+            mToken = mSource.token();
+        }
+        
+        if (e)
+        {
+            rethrow_exception(e);
+        }
     }
     
-    void cancel_pending()
+    // skip the tasks that have not started yet, and ask the running ones to stop
+    void cancel()
     {
-        unique_lock<mutex> lk(mMutex);
-        mTasks.clear();
-        mConditionVariable.notify_all();
+        mSource.cancel();
+    }
+    
+    bool is_cancelled() const
+    {
+        return mToken.is_cancelled();
     }
 };
 
+// the demo; a program that includes this file for the pool (say, the benchmark driver) defines THREAD_POOL_NO_MAIN
+#ifndef THREAD_POOL_NO_MAIN
 int multiply(int a, int b)
 {
     return a*b;   
 }
 
+// quickSort (Random/quickSort.cpp), with the two halves sorted in parallel
+// every level of the recursion waits for its halves, which a fixed size pool can only afford since the waiting thread
+// sorts them itself (or helps with something else) rather than block its worker
+void parallel_quick_sort(ThreadPool<>& tp, vector<int>& ivec, int beg, int end)
+{
+    if (end - beg < 4096)
+    {
+        sort(ivec.begin() + beg, ivec.begin() + end + 1);
+        return;
+    }
+    
+    std::swap(ivec[beg + (end - beg) / 2], ivec[end]);
+    
+    int small = beg - 1;
+    for (int i = beg; i < end; ++i)
+    {
+        if (ivec[i] < ivec[end])
+        {
+            std::swap(ivec[++small], ivec[i]);
+        }
+    }
+    
+    int pivot = small + 1;
+    std::swap(ivec[pivot], ivec[end]);
+    
+    task_group group{tp};
+    group.run([&tp, &ivec, beg, pivot](){parallel_quick_sort(tp, ivec, beg, pivot - 1);});
+    group.run([&tp, &ivec, pivot, end](){parallel_quick_sort(tp, ivec, pivot + 1, end);});
+    group.wait();
+}
+
+#ifdef __cpp_impl_coroutine
+// an I/O bound handler: while it waits on the backend, the handler holds no worker, just its coroutine frame
+task<int> handle_request(ThreadPool<>& tp, int id)
+{
+    co_await tp.schedule();
+    
+    // stands in for a call to a backend
+    int doubled = co_await tp.enqueue_task(multiply, id, 2);
+    
+    co_return doubled + 1;
+}
+
+task<int> serve(ThreadPool<>& tp, int numRequests)
+{
+    int total = 0;
+    for (int id = 0; id < numRequests; ++id)
+    {
+        total += co_await handle_request(tp, id);
+    }
+    
+    co_return total;
+}
+#endif
+
 int main()
 {
-    ThreadPool tp{};
+    {
+        ThreadPool tp{};
+        
+        auto f = tp.enqueue_task(multiply, 1, 2);
+        cout << f.get() << '\n';
+    }
+    
+    atomic<int> sum{0};
+    {
+        // fine grained tasks spawned from within the pool land on the spawning worker's deque
+        // and get stolen by the idle workers
+        ThreadPool tp{4, scheduling::work_stealing};
+        
+        auto f = tp.enqueue_task(
+            [&]()
+            {
+                for (int i = 1; i <= 1000; ++i)
+                {
+                    tp.enqueue_task([&sum, i](){sum += i;});
+                }
+            });
+        f.get();
+    } // the pool drains all queues before its workers exit
+    cout << sum << '\n';
+    
+    {
+        // a single worker, kept busy while the rest get queued, shows the order the discipline serves them in
+        ThreadPool<priority_aging<>> tp{1};
+        
+        Promise<void> gate{};
+        auto blocker = tp.enqueue_task([f = gate.get_future()]() mutable {f.get();});
+        
+        auto low = tp.enqueue_task(priority{0}, [](){cout << "low" << '\n';});
+        auto high = tp.enqueue_task(priority{2}, [](){cout << "high" << '\n';});
+        auto normal = tp.enqueue_task(priority{1}, [](){cout << "normal" << '\n';});
+        
+        gate.set_value();
+    }
+    
+    {
+        ThreadPool tp{4, scheduling::work_stealing};
+        
+        // one lock acquisition for the whole batch
+        vector<int> ids{1, 2, 3, 4, 5, 6, 7, 8};
+        atomic<int> total{0};
+        tp.enqueue_batch(ids, [&total](int id){total += id;}).get();
+        cout << total << '\n';
+        
+        // a million elements, processed in pieces of (at most) 10000
+        vector<double> v(1000000);
+        tp.parallel_for(size_t{0}, v.size(), 10000, [&v](size_t i){v[i] = 0.5 * static_cast<double>(i);});
+        
+        double sum = tp.parallel_reduce(v.begin(), v.end(), 10000, 0.0, [](auto it){return *it;}, plus<double>{});
+        cout << sum << '\n';
+    }
+    
+    {
+        // a lock-free queue of (just) 4 tasks, that turns a task down when full
+        ThreadPool<bounded_mpmc<4, backpressure::reject>> tp{1};
+        
+        Promise<void> gate{};
+        auto blocker = tp.enqueue_task([f = gate.get_future()]() mutable {f.get();});
+        
+        vector<Future<int>> futs{};
+        for (int i = 0; i < 8; ++i)
+        {
+            futs.push_back(tp.enqueue_task(multiply, i, i));
+        }
+        
+        gate.set_value();
+        
+        int numRejected{0};
+        for (auto& f : futs)
+        {
+            try
+            {
+                f.get();
+            }
+            catch (const queue_full&)
+            {
+                ++numRejected;
+            }
+        }
+        
+        // the blocker may or may not have left the queue before the burst
+        cout << "rejected " << numRejected << '\n';
+    }
+    
+    {
+        // background work never gets ahead of foreground work; within a lane, the earliest deadline goes first
+        ThreadPool<deadline_lanes> tp{1};
+        
+        Promise<void> gate{};
+        auto blocker = tp.enqueue_task([f = gate.get_future()]() mutable {f.get();});
+        
+        auto compaction = tp.enqueue_task(urgency{lane::low}, [](){cout << "compaction" << '\n';});
+        auto request1 = tp.enqueue_task(urgency{lane::high, chrono::milliseconds(200)}, [](){cout << "request1" << '\n';});
+        auto request2 = tp.enqueue_task(urgency{lane::high, chrono::milliseconds(100)}, [](){cout << "request2" << '\n';});
+        auto stale = tp.enqueue_task(urgency{lane::high, chrono::milliseconds(0)}, [](){cout << "stale" << '\n';});
+        
+        gate.set_value();
+        compaction.get();
+        
+        cout << "deadline misses " << tp.deadline_misses() << '\n';
+    }
+    
+    {
+        // one worker per core, spread over the NUMA nodes, each node with a queue of its own
+        pool_options options{};
+        options.numThreads = 4;
+        options.pinWorkers = true;
+        options.numaAware = true;
+        
+        ThreadPool tp{options};
+        
+        // run the task on the node whose memory holds the data
+        vector<int> data(1 << 20, 1);
+        auto f = tp.enqueue_task(locality::of(data.data()), [&data](){return accumulate(data.begin(), data.end(), 0);});
+        cout << f.get() << '\n';
+    }
     
-    auto f = tp.enqueue_task(multiply, 1, 2);
-    cout << f.get() << '\n';
+    {
+        // starts with a single worker, grows (up to 4) while tasks queue up for more than 1ms, and shrinks back
+        // once the extra workers have been idle for 50ms
+        pool_options options{};
+        options.numThreads = 1;
+        options.maxThreads = 4;
+        options.latencyThreshold = chrono::milliseconds(1);
+        options.idleTimeout = chrono::milliseconds(50);
+        
+        ThreadPool tp{options};
+        
+        vector<int> naps(40, 5);
+        auto batch = tp.enqueue_batch(naps, [](int ms){this_thread::sleep_for(chrono::milliseconds(ms));});
+        
+        this_thread::sleep_for(chrono::milliseconds(30));
+        cout << "busy: " << tp.num_workers() << " workers" << '\n';
+        
+        batch.get();
+        this_thread::sleep_for(chrono::milliseconds(200));
+        cout << "idle: " << tp.num_workers() << " workers" << '\n';
+    }
+    
+    {
+        // continuations get scheduled on the pool once their antecedent completes; nobody blocks but main
+        ThreadPool tp{2};
+        
+        auto chained = tp.enqueue_task(multiply, 6, 7)
+            .then([](int product){return product + 1;})
+            .then([](int answer){return to_string(answer);});
+        cout << chained.get() << '\n';
+        
+        vector<Future<int>> squares;
+        for (int i = 1; i <= 4; ++i)
+        {
+            squares.push_back(tp.enqueue_task([i](){return i * i;}));
+        }
+        
+        auto total = when_all(move(squares)).then([](vector<int> v){return accumulate(v.begin(), v.end(), 0);});
+        cout << total.get() << '\n';
+        
+        vector<Future<int>> racers;
+        racers.push_back(tp.enqueue_task([](){this_thread::sleep_for(chrono::milliseconds(50)); return 1;}));
+        racers.push_back(tp.enqueue_task([](){return 2;}));
+        
+        cout << "winner: " << when_any(move(racers)).get().second << '\n';
+    }
+    
+    {
+        // no worker sleeps through a delay; a timeout that is not needed after all gets cancelled
+        atomic<int> beats{0};
+        ThreadPool tp{2};
+        
+        auto start = chrono::steady_clock::now();
+        auto late = tp.enqueue_after(chrono::milliseconds(50), [start]()
+        {
+            return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() >= 50;
+        });
+        
+        auto timeout = tp.enqueue_after(chrono::seconds(30), [](){cout << "timed out" << '\n';});
+        tp.cancel_timer(timeout.timer());
+        
+        timer_id heartbeat = tp.enqueue_every(chrono::milliseconds(10), [&beats](){++beats;});
+        
+        cout << "on time: " << late.get() << '\n';
+        try
+        {
+            timeout.get();
+        }
+        catch (const task_cancelled& e)
+        {
+            cout << e.what() << '\n';
+        }
+        
+        this_thread::sleep_for(chrono::milliseconds(100));
+        tp.cancel_timer(heartbeat);
+        cout << "heartbeats: " << (beats >= 5 ? "yes" : "no") << '\n';
+    }
+    
+    {
+        // a group of tasks gets cancelled as a whole: the ones queued never start, the running one stops early
+        ThreadPool tp{1};
+        cancellation_source group{};
+        
+        auto poll = [](){
+            int rounds = 0;
+            while (!this_task::cancellation_requested() && rounds < 1000)
+            {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                ++rounds;
+            }
+            return rounds;
+        };
+        
+        auto running = tp.enqueue_task(group.token(), poll);
+        auto queued = tp.enqueue_task(group.token(), poll);
+        
+        this_thread::sleep_for(chrono::milliseconds(20));
+        group.cancel();
+        
+        cout << "stopped early: " << (running.get() < 1000) << '\n';
+        try
+        {
+            queued.get();
+        }
+        catch (const task_cancelled& e)
+        {
+            cout << e.what() << '\n';
+        }
+        
+        // a deploy does not wait for the backlog: the queued tasks are dropped, the running one is asked to stop
+        for (int i = 0; i < 100; ++i)
+        {
+            tp.enqueue_task(poll);
+        }
+        
+        this_thread::sleep_for(chrono::milliseconds(5));
+        cout << "shut down in time: " << tp.shutdown_now(chrono::milliseconds(500)) << '\n';
+    }
+    
+    {
+        // nested fork-join on two workers: about a thousand groups, each waited for from within a pool task
+        ThreadPool tp{2, scheduling::work_stealing};
+        
+        vector<int> ivec(1 << 21);
+        generate(ivec.begin(), ivec.end(), [x = 12345u]() mutable {x = x * 1103515245 + 12345; return static_cast<int>(x >> 8);});
+        
+        parallel_quick_sort(tp, ivec, 0, static_cast<int>(ivec.size()) - 1);
+        cout << "sorted: " << is_sorted(ivec.begin(), ivec.end()) << '\n';
+    }
+    
+#ifdef THREAD_POOL_TELEMETRY
+    {
+        ThreadPool tp{2, scheduling::work_stealing};
+        
+        vector<int> ivec(1 << 20, 1);
+        tp.parallel_for(size_t(0), ivec.size(), 1024, [&ivec](size_t i){ivec[i] *= 2;});
+        
+        for (int i = 0; i < 1000; ++i)
+        {
+            tp.enqueue_task([](){}).get();
+        }
+        
+        cout << tp.stats();
+    }
+#endif
+    
+#ifdef __cpp_impl_coroutine
+    {
+        // thousands of requests in flight on two workers
+        ThreadPool tp{2};
+        
+        vector<Future<int>> responses;
+        for (int id = 0; id < 5000; ++id)
+        {
+            responses.push_back(tp.spawn(handle_request(tp, id)));
+        }
+        
+        auto all = when_all(move(responses)).get();
+        cout << accumulate(all.begin(), all.end(), 0) << '\n';
+        cout << tp.spawn(serve(tp, 100)).get() << '\n';
+    }
+#endif
     
     return 0;
 }
+#endif
@@ -6,6 +6,21 @@
 #include <vector>
 #include <map>
 #include <thread>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 template <typename T, typename = std::void_t<>>
 struct has_indirection : std::false_type
@@ -18,21 +33,289 @@ struct has_indirection<T, std::void_t<decltype(std::declval<T>().operator->())>>
 template <typename Resource>
 using disable_for_indirection = std::enable_if_t<!has_indirection<Resource>::value>;
 
-template <typename Resource, typename = disable_for_indirection<std::decay_t<Resource>>>
+// the synchronization policies of thread_safe<Resource, Policy>
+//
+// locked<Mutex>: every access to the underlying locks a Mutex associated with it (the default)
+//                Mutex can be any type meeting the *SharedMutex* named requirements; std::shared_mutex unless told otherwise
+//                (see big_reader_mutex for read-mostly resources shared by many cores)
+// rcu: read-copy-update; readers get a wait-free snapshot of the current version of the underlying,
+//      writers modify a private copy of it and publish that copy atomically on release,
+//      and superseded versions are reclaimed once no reader can still be looking at them
+// seqlock: a sequence lock; readers copy the underlying optimistically and retry if a writer got in meanwhile,
+//          writers are serialized by the low bit of the sequence
+//          picked by default for trivially copyable resources of up to seqlock_max_size bytes, which are cheaper to copy than to lock
+template <typename Mutex = std::shared_mutex>
+struct locked {
+    using mutex_type = Mutex;
+};
+
+struct rcu {};
+struct seqlock {};
+
+inline constexpr std::size_t seqlock_max_size = 64;
+
+template <typename Resource>
+using default_policy = std::conditional_t<std::is_trivially_copyable_v<Resource> && sizeof(Resource) <= seqlock_max_size, seqlock, locked<>>;
+
+// epoch based reclamation for thread_safe<Resource, rcu>
+//
+// every reader thread owns a slot, on a cache line of its own, in which it announces the global epoch it saw on entering a read section
+// a writer tags each superseded version with the epoch it got retired in and bumps the global epoch
+// that version may be reclaimed once every slot is either quiescent or past its tag
+//
+// on linux, membarrier(2) lets the writer issue the full fence on behalf of every reader,
+// so entering a read section costs a load of the epoch and a store to the reader's own slot
+// elsewhere, readers fall back to a fence of their own
+class rcu_domain {
+
+    struct alignas(64) slot {
+        // 0 while the owning thread is outside any read section
+        std::atomic<std::uint64_t> epoch{0};
+        bool used{false};
+        slot* next{nullptr};
+    };
+
+    inline static std::atomic<std::uint64_t> epoch{1};
+
+    // the slots are never freed; those of exited threads get reused
+    inline static std::mutex registry{};
+    inline static slot* slots{nullptr};
+    inline static bool initialized{false};
+    inline static bool asymmetric{false};
+
+    inline static thread_local slot* mine{nullptr};
+    inline static thread_local unsigned nesting{0};
+
+    static slot* enroll() {
+        // hands the slot back when the thread exits
+        struct leave {
+            ~leave() {
+                std::lock_guard<std::mutex> guard(registry);
+                mine->used = false;
+                mine = nullptr;
+            }
+        };
+
+        std::lock_guard<std::mutex> guard(registry);
+
+        if (!initialized) {
+#ifdef __linux__
+            asymmetric = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#endif
+            initialized = true;
+        }
+
+        slot* s = slots;
+        while (s && s->used) {
+            s = s->next;
+        }
+
+        if (!s) {
+            s = new slot;
+            s->next = slots;
+            slots = s;
+        }
+
+        s->used = true;
+        mine = s;
+
+        static thread_local leave onExit;
+        (void)onExit;
+
+        return s;
+    }
+
+    // orders the store to a reader's slot before its loads of the published versions
+    static void light_fence() {
+        if (asymmetric) {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+        else {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    // the writer side of light_fence()
+    static void heavy_fence() {
+#ifdef __linux__
+        if (asymmetric) {
+            syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+            return;
+        }
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+public:
+
+    // read sections nest; only the outermost one touches the slot
+    static void read_lock() {
+        if (nesting++ == 0) {
+            slot* s = mine ? mine : enroll();
+            s->epoch.store(epoch.load(std::memory_order_acquire), std::memory_order_release);
+            light_fence();
+        }
+    }
+
+    static void read_unlock() {
+        if (--nesting == 0) {
+            mine->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    // to be called once a version has been unpublished
+    // returns the tag of that version; readers entering from now on can't see it
+    static std::uint64_t retire() {
+        return epoch.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // the oldest epoch any reader may still be reading in
+    // versions tagged before it can be reclaimed
+    static std::uint64_t oldest_reader() {
+        std::lock_guard<std::mutex> guard(registry);
+
+        heavy_fence();
+
+        std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+        for (slot* s = slots; s; s = s->next) {
+            std::uint64_t e = s->epoch.load(std::memory_order_acquire);
+            if (e != 0 && e < oldest) {
+                oldest = e;
+            }
+        }
+
+        return oldest;
+    }
+};
+
+// a reader-biased shared mutex, after the big-reader locks of the linux kernel
+//
+// each thread owns one of the slots, on a cache line of its own, and lock_shared() just counts the reader in there
+// so readers on different cores never write to the same cache line; they only read the writer's flag, which stays put while there's no writer
+// a writer raises that flag and waits for every slot to drain, which makes lock() dearer than that of std::shared_mutex
+// readers back off while the flag is raised, so writers don't starve
+//
+// like the locks of std::shared_mutex, a shared lock must be released by the thread that acquired it
+class big_reader_mutex {
+
+public:
+
+    // threads beyond that many share slots, which is still correct but brings the contention back
+    static constexpr std::size_t slots = 64;
+
+private:
+
+    struct alignas(64) slot {
+        std::atomic<unsigned> readers{0};
+    };
+
+    slot indicators[slots]{};
+
+    alignas(64) std::atomic<bool> writing{false};
+
+    // serializes the writers
+    alignas(64) std::mutex writer{};
+
+    // threads get their slots round robin, for life
+    static std::size_t mine() {
+        static std::atomic<std::size_t> next{0};
+        static thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % slots;
+        return index;
+    }
+
+    // the seq_cst increment of a slot followed by the seq_cst load of the flag pairs with the seq_cst store of the flag in lock() followed by
+    // the seq_cst loads of the slots in drained(); with all four seq_cst, at least one side sees the other
+    bool enter(slot& s) {
+        s.readers.fetch_add(1, std::memory_order_seq_cst);
+        if (!writing.load(std::memory_order_seq_cst)) {
+            return true;
+        }
+
+        s.readers.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    // seq_cst rather than acquire: an acquire load may be reordered before the preceding store of the flag
+    bool drained() const {
+        for (const slot& s : indicators) {
+            if (s.readers.load(std::memory_order_seq_cst) != 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+public:
+
+    big_reader_mutex() = default;
+
+    big_reader_mutex(const big_reader_mutex&) = delete;
+    big_reader_mutex& operator=(const big_reader_mutex&) = delete;
+
+    void lock_shared() {
+        slot& s = indicators[mine()];
+        while (!enter(s)) {
+            while (writing.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    bool try_lock_shared() {
+        return enter(indicators[mine()]);
+    }
+
+    void unlock_shared() {
+        indicators[mine()].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lock() {
+        writer.lock();
+        writing.store(true, std::memory_order_seq_cst);
+        while (!drained()) {
+            std::this_thread::yield();
+        }
+    }
+
+    bool try_lock() {
+        if (!writer.try_lock()) {
+            return false;
+        }
+
+        writing.store(true, std::memory_order_seq_cst);
+        if (!drained()) {
+            writing.store(false, std::memory_order_release);
+            writer.unlock();
+            return false;
+        }
+
+        return true;
+    }
+
+    void unlock() {
+        writing.store(false, std::memory_order_release);
+        writer.unlock();
+    }
+};
+
+template <typename Resource, typename Policy = default_policy<std::decay_t<Resource>>, typename = disable_for_indirection<std::decay_t<Resource>>>
 class thread_safe {
 
     // all thread_safe instantiations are friends
-    template<typename, typename>
+    template<typename, typename, typename>
     friend class thread_safe;
     
+    using mutex_type = typename Policy::mutex_type;
+
     // the underlying
     std::shared_ptr<Resource> ptr{};
     
     // the protection
-    std::shared_ptr<std::shared_mutex> mtx{};
+    std::shared_ptr<mutex_type> mtx{};
     
-    // for unique_lock requests, ResourceT = std::decay_t<Resource> and lock_t = unique_lock<std::shared_mutex>
-    // for shared_lock requests, ResourceT = const std::decay_t<Resource> and lock_t = shared_lock<std::shared_mutex>
+    // for unique_lock requests, ResourceT = std::decay_t<Resource> and lock_t = unique_lock<mutex_type>
+    // for shared_lock requests, ResourceT = const std::decay_t<Resource> and lock_t = shared_lock<mutex_type>
     template <typename ResourceT, typename lock_t>
     class proxy {
         
@@ -51,13 +334,13 @@ class thread_safe {
         //
         // for shared_lock requests, acquire shared ownership of the mutex
         // if another thread is holding the mutex in exclusive ownership, block execution until shared ownership can be acquired
-        proxy(ResourceT* p, std::shared_mutex& mtx)
+        proxy(ResourceT* p, mutex_type& mtx)
         : pUnderlying(p), lock(mtx) {
 	    // the unique/shared lock must have an associated mutex with exclusive/shared ownership of it
             assert(owns_lock());
         }
         
-        proxy(ResourceT* p, std::shared_mutex& mtx, std::adopt_lock_t)
+        proxy(ResourceT* p, mutex_type& mtx, std::adopt_lock_t)
         : pUnderlying(p), lock(mtx, std::adopt_lock) {
 	    // the unique/shared lock must have an associated mutex with exclusive/shared ownership of it
             assert(owns_lock());
@@ -104,7 +387,7 @@ public:
     // default constructing a thread_safe<Resource> object requires the type Resource to be default constructible
     template <typename T = ResourceType, typename = std::enable_if_t<std::is_default_constructible_v<T>>>
     thread_safe()
-    : ptr(std::make_shared<ResourceType>()), mtx(std::make_shared<std::shared_mutex>()) {}
+    : ptr(std::make_shared<ResourceType>()), mtx(std::make_shared<mutex_type>()) {}
 
     // universal ctor
     // intended to construct the underlying by invoking a viable ctor of the underlying using the parameters of this universal ctor
@@ -115,10 +398,10 @@ public:
     // thus disabled for such scenarios
     template <typename T, typename... Args, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, thread_safe>>>
     thread_safe(T&& t, Args&&... args)
-    : ptr(std::make_shared<ResourceType>(std::forward<T>(t), std::forward<Args>(args)...)), mtx(std::make_shared<std::shared_mutex>()) {}
+    : ptr(std::make_shared<ResourceType>(std::forward<T>(t), std::forward<Args>(args)...)), mtx(std::make_shared<mutex_type>()) {}
     
     thread_safe(std::unique_ptr<ResourceType> pResource)
-    : ptr(std::move(pResource)), mtx(std::make_shared<std::shared_mutex>()) {}
+    : ptr(std::move(pResource)), mtx(std::make_shared<mutex_type>()) {}
     
     // copy enabled
     thread_safe(const thread_safe& source) = default;
@@ -130,7 +413,7 @@ public:
     
     // generic converting ctor
     template <typename T>
-    thread_safe(thread_safe<T>& other)
+    thread_safe(thread_safe<T, Policy>& other)
     : ptr(other.ptr), mtx(other.mtx) {}
     
     // implement the *Lockable* and *SharedLockable* named requirements
@@ -163,23 +446,546 @@ public:
     // a unique_lock request should only come from a non-const thread_safe object
     // hence this api is non-const
     auto unique_lock() {
-        return proxy<ResourceType, std::unique_lock<std::shared_mutex>>(ptr.get(), *mtx);
+        return proxy<ResourceType, std::unique_lock<mutex_type>>(ptr.get(), *mtx);
     }
     
     auto unique_lock(std::adopt_lock_t) {
-        return proxy<ResourceType, std::unique_lock<std::shared_mutex>>(ptr.get(), *mtx, std::adopt_lock);
+        return proxy<ResourceType, std::unique_lock<mutex_type>>(ptr.get(), *mtx, std::adopt_lock);
     }
     
     // a shared_lock request should only come from a const thread_safe object
     // hence this api is const
     auto shared_lock() const {
-        return proxy<const ResourceType, std::shared_lock<std::shared_mutex>>(ptr.get(), *mtx);
+        return proxy<const ResourceType, std::shared_lock<mutex_type>>(ptr.get(), *mtx);
     }
     
     auto shared_lock(std::adopt_lock_t) const {
-        return proxy<const ResourceType, std::shared_lock<std::shared_mutex>>(ptr.get(), *mtx, std::adopt_lock);
+        return proxy<const ResourceType, std::shared_lock<mutex_type>>(ptr.get(), *mtx, std::adopt_lock);
+    }
+};
+
+// read-copy-update
+// a reader never blocks and never writes to memory it shares with another thread; it just picks up the current version
+// writers are serialized by a mutex: each one works on a private copy of the current version and publishes it with a single atomic exchange
+// Resource must be copy constructible
+template <typename Resource, typename Enable>
+class thread_safe<Resource, rcu, Enable> {
+
+    // all thread_safe instantiations are friends
+    template<typename, typename, typename>
+    friend class thread_safe;
+
+public:
+
+    using ResourceType = std::decay_t<Resource>;
+
+private:
+
+    struct state {
+
+        // the published version
+        std::atomic<ResourceType*> current{nullptr};
+
+        // serializes the writers, and guards the retired versions
+        std::mutex writer{};
+
+        // superseded versions along with their tags
+        std::vector<std::pair<std::uint64_t, ResourceType*>> retired{};
+
+        explicit state(std::unique_ptr<ResourceType> pResource)
+        : current(pResource.release()) {}
+
+        // no thread may be reading once the last thread_safe sharing this state is gone
+        ~state() {
+            delete current.load(std::memory_order_relaxed);
+            for (auto& version : retired) {
+                delete version.second;
+            }
+        }
+
+        // to be called with the writer mutex held, and with room for one more retired version
+        void publish(ResourceType* next) {
+            ResourceType* previous = current.exchange(next, std::memory_order_seq_cst);
+            retired.emplace_back(rcu_domain::retire(), previous);
+
+            // reclaim whatever no reader can still be looking at
+            std::uint64_t oldest = rcu_domain::oldest_reader();
+            auto it = retired.begin();
+            for (; it != retired.end() && it->first < oldest; ++it) {
+                delete it->second;
+            }
+            retired.erase(retired.begin(), it);
+        }
+    };
+
+    std::shared_ptr<state> st{};
+
+    // an empty unique_ptr leaves no version to publish; the underlying gets value initialized then, as by the default ctor
+    static std::unique_ptr<ResourceType> adopt(std::unique_ptr<ResourceType> pResource) {
+        if (pResource) {
+            return pResource;
+        }
+
+        if constexpr (std::is_default_constructible_v<ResourceType>) {
+            return std::make_unique<ResourceType>();
+        }
+        else {
+            throw std::invalid_argument("thread_safe: an empty unique_ptr to a resource that isn't default constructible");
+        }
+    }
+
+    // a read section on the version that was current when it got created
+    // it must be released in the thread that created it
+    class read_proxy {
+
+    public:
+
+        using ResourceType = const typename thread_safe::ResourceType;
+
+    private:
+
+        mutable ResourceType* pUnderlying{nullptr};
+
+        // whether this proxy still has to leave its read section
+        mutable bool owned{false};
+
+    public:
+
+        explicit read_proxy(const state& s)
+        : owned(true) {
+            rcu_domain::read_lock();
+            pUnderlying = s.current.load(std::memory_order_acquire);
+        }
+
+        read_proxy(const state& s, std::adopt_lock_t)
+        : pUnderlying(s.current.load(std::memory_order_acquire)), owned(true) {}
+
+        // move enabled
+        read_proxy(read_proxy&& rhs)
+        : pUnderlying(rhs.pUnderlying), owned(rhs.owned) {
+            rhs.pUnderlying = nullptr;
+            rhs.owned = false;
+        }
+
+        // copy disabled
+        read_proxy(const read_proxy& rhs) = delete;
+
+        ~read_proxy() noexcept {
+            if (owns_lock()) {
+                unlock();
+            }
+        }
+
+        ResourceType* operator->() const {
+            return pUnderlying;
+        }
+
+        ResourceType& operator*() const {
+            return *pUnderlying;
+        }
+
+        void unlock() const {
+            rcu_domain::read_unlock();
+            pUnderlying = nullptr;
+            owned = false;
+        }
+
+        bool owns_lock() const {
+            return owned;
+        }
+    };
+
+    // a private copy of the current version, published when the proxy releases the writer mutex
+    class write_proxy {
+
+    public:
+
+        using ResourceType = typename thread_safe::ResourceType;
+
+    private:
+
+        mutable state* pState{nullptr};
+        mutable std::unique_lock<std::mutex> lock{};
+        mutable std::unique_ptr<ResourceType> pUnderlying{};
+
+    public:
+
+        explicit write_proxy(state& s)
+        : pState(&s), lock(s.writer) {
+            copy();
+        }
+
+        write_proxy(state& s, std::adopt_lock_t)
+        : pState(&s), lock(s.writer, std::adopt_lock) {
+            copy();
+        }
+
+        // move enabled
+        write_proxy(write_proxy&& rhs) = default;
+
+        // copy disabled
+        write_proxy(const write_proxy& rhs) = delete;
+
+        // publishing the copy can't throw, so neither can the release
+        ~write_proxy() noexcept {
+            if (owns_lock()) {
+                unlock();
+            }
+        }
+
+        ResourceType* operator->() const {
+            return pUnderlying.get();
+        }
+
+        ResourceType& operator*() const {
+            return *pUnderlying;
+        }
+
+        void unlock() const {
+            pState->publish(pUnderlying.release());
+            lock.unlock();
+        }
+
+        bool owns_lock() const {
+            return lock.owns_lock();
+        }
+
+    private:
+
+        // the writer mutex orders this load after the previous publish
+        void copy() {
+            pUnderlying = std::make_unique<ResourceType>(*pState->current.load(std::memory_order_relaxed));
+            pState->retired.reserve(pState->retired.size() + 1);
+        }
+    };
+
+public:
+
+    template <typename T = ResourceType, typename = std::enable_if_t<std::is_default_constructible_v<T>>>
+    thread_safe()
+    : st(std::make_shared<state>(std::make_unique<ResourceType>())) {}
+
+    template <typename T, typename... Args, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, thread_safe>>>
+    thread_safe(T&& t, Args&&... args)
+    : st(std::make_shared<state>(std::make_unique<ResourceType>(std::forward<T>(t), std::forward<Args>(args)...))) {}
+
+    thread_safe(std::unique_ptr<ResourceType> pResource)
+    : st(std::make_shared<state>(adopt(std::move(pResource)))) {}
+
+    // copy enabled
+    thread_safe(const thread_safe& source) = default;
+    thread_safe& operator=(const thread_safe&) = default;
+
+    // move enabled
+    thread_safe(thread_safe&&) = default;
+    thread_safe& operator=(thread_safe&&) = default;
+
+    // *Lockable* and *SharedLockable*, as for the locked policy
+    // the exclusive side serializes writers only; it never holds readers off
+    void lock() const {
+        st->writer.lock();
+    }
+
+    void lock_shared() const {
+        rcu_domain::read_lock();
+    }
+
+    bool try_lock() const {
+        return st->writer.try_lock();
+    }
+
+    bool try_lock_shared() const {
+        rcu_domain::read_lock();
+        return true;
+    }
+
+    void unlock() const {
+        st->writer.unlock();
+    }
+
+    void unlock_shared() const {
+        rcu_domain::read_unlock();
+    }
+
+    // modifications made through the proxy become visible to readers, all at once, when it is released
+    auto unique_lock() {
+        return write_proxy(*st);
+    }
+
+    auto unique_lock(std::adopt_lock_t) {
+        return write_proxy(*st, std::adopt_lock);
+    }
+
+    // a snapshot; writers publishing meanwhile neither wait for it nor change it
+    auto shared_lock() const {
+        return read_proxy(*st);
+    }
+
+    auto shared_lock(std::adopt_lock_t) const {
+        return read_proxy(*st, std::adopt_lock);
+    }
+};
+
+// sequence lock
+// a reader never writes to memory it shares with another thread: it copies the underlying out, and retries if the sequence moved meanwhile
+// a writer takes the lock by making the sequence odd, works on a copy of its own, and copies it back in on release
+// the underlying is kept as words of atomics, so that a reader racing with a writer reads torn words at worst (and then retries), never undefined behaviour
+// Resource must be trivially copyable
+template <typename Resource, typename Enable>
+class thread_safe<Resource, seqlock, Enable> {
+
+    // all thread_safe instantiations are friends
+    template<typename, typename, typename>
+    friend class thread_safe;
+
+public:
+
+    using ResourceType = std::decay_t<Resource>;
+
+    static_assert(std::is_trivially_copyable_v<ResourceType>, "the seqlock policy requires a trivially copyable resource");
+
+private:
+
+    using word = std::uintptr_t;
+
+    static constexpr std::size_t words = (sizeof(ResourceType) + sizeof(word) - 1) / sizeof(word);
+
+    // a copy of the underlying, private to a proxy
+    struct copy {
+
+        alignas(ResourceType) alignas(word) unsigned char bytes[words * sizeof(word)]{};
+
+        ResourceType* get() {
+            return std::launder(reinterpret_cast<ResourceType*>(bytes));
+        }
+    };
+
+    struct alignas(64) state {
+
+        // odd while a writer holds the lock
+        std::atomic<unsigned> seq{0};
+
+        std::atomic<word> data[words]{};
+
+        explicit state(const ResourceType& r) {
+            copy c{};
+            std::memcpy(c.bytes, &r, sizeof(ResourceType));
+            store(c);
+        }
+
+        void load(copy& c) const {
+            for (std::size_t i = 0; i < words; ++i) {
+                word w = data[i].load(std::memory_order_relaxed);
+                std::memcpy(c.bytes + i * sizeof(word), &w, sizeof(word));
+            }
+        }
+
+        void store(const copy& c) {
+            for (std::size_t i = 0; i < words; ++i) {
+                word w;
+                std::memcpy(&w, c.bytes + i * sizeof(word), sizeof(word));
+                data[i].store(w, std::memory_order_relaxed);
+            }
+        }
+
+        // optimistic; retries until no writer got in while copying
+        void read(copy& c) const {
+            for (;;) {
+                unsigned before = seq.load(std::memory_order_acquire);
+                if (before & 1) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                load(c);
+
+                // keeps the loads above from sinking below the check
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq.load(std::memory_order_relaxed) == before) {
+                    return;
+                }
+            }
+        }
+
+        bool try_acquire() {
+            unsigned s = seq.load(std::memory_order_relaxed);
+            return !(s & 1) && seq.compare_exchange_strong(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void acquire() {
+            while (!try_acquire()) {
+                std::this_thread::yield();
+            }
+        }
+
+        void release() {
+            seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // to be called with the lock held
+        void publish(const copy& c) {
+            // keeps the stores below from rising above the odd sequence
+            std::atomic_thread_fence(std::memory_order_release);
+            store(c);
+            release();
+        }
+    };
+
+    std::shared_ptr<state> st{};
+
+    // an empty unique_ptr has nothing to copy in; the underlying gets value initialized then, as by the default ctor
+    static ResourceType adopt(const std::unique_ptr<ResourceType>& pResource) {
+        if (pResource) {
+            return *pResource;
+        }
+
+        if constexpr (std::is_default_constructible_v<ResourceType>) {
+            return ResourceType();
+        }
+        else {
+            throw std::invalid_argument("thread_safe: an empty unique_ptr to a resource that isn't default constructible");
+        }
     }
-}; 
+
+    // for unique_lock requests, the copy is copied back in on release
+    // for shared_lock requests, it is a snapshot; an adopted shared lock is released along with the proxy
+    template <typename ResourceT>
+    class proxy {
+
+        mutable copy snapshot{};
+        mutable state* pState{nullptr};
+        mutable bool owned{false};
+
+    public:
+
+        using ResourceType = ResourceT;
+
+        // unique_lock requests
+        explicit proxy(state& s)
+        : pState(&s), owned(true) {
+            s.acquire();
+            s.load(snapshot);
+        }
+
+        // shared_lock requests
+        explicit proxy(const state& s)
+        : owned(true) {
+            s.read(snapshot);
+        }
+
+        // both; the sequence is odd, so nobody else writes
+        proxy(state& s, std::adopt_lock_t)
+        : pState(&s), owned(true) {
+            s.load(snapshot);
+        }
+
+        // move enabled
+        proxy(proxy&& rhs)
+        : snapshot(rhs.snapshot), pState(rhs.pState), owned(rhs.owned) {
+            rhs.pState = nullptr;
+            rhs.owned = false;
+        }
+
+        // copy disabled
+        proxy(const proxy& rhs) = delete;
+
+        ~proxy() noexcept {
+            if (owned) {
+                unlock();
+            }
+        }
+
+        ResourceT* operator->() const {
+            return snapshot.get();
+        }
+
+        ResourceT& operator*() const {
+            return *snapshot.get();
+        }
+
+        void unlock() const {
+            if (pState) {
+                if constexpr (std::is_const_v<ResourceT>) {
+                    pState->release();
+                }
+                else {
+                    pState->publish(snapshot);
+                }
+                pState = nullptr;
+            }
+            owned = false;
+        }
+
+        bool owns_lock() const {
+            return owned;
+        }
+    };
+
+public:
+
+    template <typename T = ResourceType, typename = std::enable_if_t<std::is_default_constructible_v<T>>>
+    thread_safe()
+    : st(std::make_shared<state>(ResourceType())) {}
+
+    template <typename T, typename... Args, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, thread_safe>>>
+    thread_safe(T&& t, Args&&... args)
+    : st(std::make_shared<state>(ResourceType(std::forward<T>(t), std::forward<Args>(args)...))) {}
+
+    // the resource gets copied in, and the unique_ptr dropped
+    thread_safe(std::unique_ptr<ResourceType> pResource)
+    : st(std::make_shared<state>(adopt(pResource))) {}
+
+    // copy enabled
+    thread_safe(const thread_safe& source) = default;
+    thread_safe& operator=(const thread_safe&) = default;
+
+    // move enabled
+    thread_safe(thread_safe&&) = default;
+    thread_safe& operator=(thread_safe&&) = default;
+
+    // *Lockable* and *SharedLockable*, as for the locked policy
+    // there's a single spin bit, so a shared lock taken this way is exclusive; the optimistic shared_lock() below takes none
+    void lock() const {
+        st->acquire();
+    }
+
+    void lock_shared() const {
+        st->acquire();
+    }
+
+    bool try_lock() const {
+        return st->try_acquire();
+    }
+
+    bool try_lock_shared() const {
+        return st->try_acquire();
+    }
+
+    void unlock() const {
+        st->release();
+    }
+
+    void unlock_shared() const {
+        st->release();
+    }
+
+    auto unique_lock() {
+        return proxy<ResourceType>(*st);
+    }
+
+    auto unique_lock(std::adopt_lock_t) {
+        return proxy<ResourceType>(*st, std::adopt_lock);
+    }
+
+    // a snapshot; later writes don't change it
+    auto shared_lock() const {
+        return proxy<const ResourceType>(std::as_const(*st));
+    }
+
+    auto shared_lock(std::adopt_lock_t) const {
+        return proxy<const ResourceType>(*st, std::adopt_lock);
+    }
+};
 
 class Base {
   
@@ -245,6 +1051,7 @@ struct Foo
 
 
 // works with fundamental types
+// (small trivially copyable resources, such as int and Foo, get the seqlock policy by default)
 thread_safe<int> safeInt(42);
 
 // works with user defined types
@@ -307,7 +1114,8 @@ thread_safe<std::map<int, int>> safeMap_copy{};
 
 void f3()
 {
-    std::scoped_lock aLock(safeMap, safeMap_copy);
+    // the proxies below adopt these locks and release them
+    std::lock(safeMap, safeMap_copy);
 
     {
         auto mapRef = safeMap.unique_lock(std::adopt_lock);
@@ -322,7 +1130,8 @@ void f3()
  
 void f4()
 {
-    std::scoped_lock aLock(safeMap_copy, safeMap);
+    // the proxies below adopt these locks and release them
+    std::lock(safeMap_copy, safeMap);
 
     {
         auto mapRef = safeMap.unique_lock(std::adopt_lock);
@@ -335,6 +1144,54 @@ void f4()
     }
 }
 
+// read-mostly resources can opt into read-copy-update
+thread_safe<std::map<int, int>, rcu> safeConfig{};
+
+void f5()
+{
+    // readers never wait for the writer in thread t6
+    // each shared_lock() hands out a consistent snapshot, i.e., a version published as a whole by some unique_lock()
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto configRef = safeConfig.shared_lock();
+        assert(configRef->empty() || configRef->at(1) == configRef->at(2));
+    }
+}
+
+void f6()
+{
+    for (int i = 1; i <= 100; ++i)
+    {
+        // modifies a private copy of the current version...
+        auto configRef = safeConfig.unique_lock();
+        (*configRef)[1] = i;
+        (*configRef)[2] = i;
+    } // ...and publishes it here
+}
+
+// read-mostly resources can also stay locked, by a reader-biased mutex
+thread_safe<std::vector<int>, locked<big_reader_mutex>> safeRoutes(std::vector<int>{1, 2, 3});
+
+void f7()
+{
+    // readers in different threads count themselves in different cache lines
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto routesRef = safeRoutes.shared_lock();
+        assert(routesRef->size() >= 3);
+    }
+}
+
+void f8()
+{
+    for (int i = 0; i < 10; ++i)
+    {
+        // waits for the readers in thread t7 to drain, and holds new ones off meanwhile
+        auto routesRef = safeRoutes.unique_lock();
+        routesRef->push_back(i);
+    }
+}
+
 int main()
 {
     std::thread t1(f1);
@@ -377,6 +1234,30 @@ int main()
         std::cout << (*mapCopyRef)[2] << '\n';
     }
 
+    std::thread t5(f5);
+    std::thread t6(f6);
+
+    t5.join();
+    t6.join();
+
+    // the last version published in thread t6
+    std::cout << safeConfig.shared_lock()->at(1) << '\n';
+
+    std::thread t7(f7);
+    std::thread t8(f8);
+
+    t7.join();
+    t8.join();
+
+    std::cout << safeRoutes.shared_lock()->size() << '\n';
+
+    // an empty unique_ptr gives a value initialized underlying
+    thread_safe<int> safeEmpty(std::unique_ptr<int>{});
+    std::cout << *safeEmpty.shared_lock() << '\n';
+
+    thread_safe<std::map<int, int>, rcu> safeEmptyConfig(std::unique_ptr<std::map<int, int>>{});
+    std::cout << safeEmptyConfig.shared_lock()->size() << '\n';
+
     return 0;
 }
 
@@ -394,5 +1275,9 @@ a
 2
 1
 2
+100
+13
+0
+0
 Program ended with exit code: 0
 */